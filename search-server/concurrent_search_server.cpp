@@ -0,0 +1,85 @@
+#include "concurrent_search_server.h"
+
+#include <atomic>
+#include <utility>
+
+ConcurrentSearchServer::ConcurrentSearchServer(const std::string& stop_words_text, size_t shard_count,
+    PostingFormat posting_format, WordPositions word_positions)
+    : ConcurrentSearchServer(SplitIntoWords(stop_words_text), shard_count, posting_format, word_positions) {
+}
+
+std::shared_ptr<const SearchServer> ConcurrentSearchServer::GetSnapshot() const {
+    return std::atomic_load(&published_);
+}
+
+void ConcurrentSearchServer::AddDocument(int document_id, std::string_view document, DocumentStatus status,
+    const std::vector<int>& ratings) {
+    ApplyChange([document_id, text = std::string(document), status, ratings](SearchServer& server) {
+        server.AddDocument(document_id, text, status, ratings);
+        });
+}
+
+void ConcurrentSearchServer::AddDocuments(const std::vector<DocumentToAdd>& documents) {
+    // тексты копируются: при повторе на втором экземпляре исходных строк уже может не быть
+    auto texts = std::make_shared<std::vector<std::string>>();
+    auto batch = std::make_shared<std::vector<DocumentToAdd>>(documents);
+    texts->reserve(documents.size());
+    for (DocumentToAdd& document : *batch) {
+        texts->emplace_back(document.text);
+        document.text = texts->back();
+    }
+    ApplyChange([texts, batch](SearchServer& server) {
+        server.AddDocuments(*batch);
+        });
+}
+
+void ConcurrentSearchServer::RemoveDocument(int document_id) {
+    ApplyChange([document_id](SearchServer& server) {
+        server.RemoveDocument(document_id);
+        });
+}
+
+void ConcurrentSearchServer::RemoveDocuments(const std::vector<int>& document_ids) {
+    ApplyChange([document_ids](SearchServer& server) {
+        server.RemoveDocuments(document_ids);
+        });
+}
+
+void ConcurrentSearchServer::Publish() {
+    std::lock_guard lock(writer_mutex_);
+    if (pending_changes_.empty()) {
+        return;
+    }
+    std::future<void> released = PublishServer(hidden_);
+    hidden_ = 1 - hidden_;
+    // читатели прежней версии доделывают запросы; после этого экземпляр снова принадлежит только писателю
+    if (released.wait_for(PUBLISH_RELEASE_TIMEOUT) == std::future_status::ready) {
+        for (const auto& change : pending_changes_) {
+            change(*servers_[hidden_]);
+        }
+    } else {
+        // Прежнюю версию кто-то держит, и ждать его нельзя: он может и не отпустить ее до конца Publish.
+        // Она достается читателям, а скрытым становится копия опубликованной - ее читатели только читают
+        servers_[hidden_] = std::make_shared<SearchServer>(*servers_[1 - hidden_]);
+    }
+    pending_changes_.clear();
+}
+
+std::future<void> ConcurrentSearchServer::PublishServer(size_t index) {
+    // версия держит сервер, пока ее не отпустит последний читатель, и сообщает об этом писателю
+    auto release = std::make_shared<std::promise<void>>();
+    std::future<void> released = release->get_future();
+    std::shared_ptr<const SearchServer> version(servers_[index].get(), [server = servers_[index], release](const SearchServer*) {
+        release->set_value();
+        });
+    std::atomic_store(&published_, std::move(version));
+    std::swap(published_released_, released);
+    return released;
+}
+
+void ConcurrentSearchServer::ApplyChange(std::function<void(SearchServer&)> change) {
+    std::lock_guard lock(writer_mutex_);
+    // если изменение бросит исключение, скрытый экземпляр останется прежним и повторять будет нечего
+    change(*servers_[hidden_]);
+    pending_changes_.push_back(std::move(change));
+}
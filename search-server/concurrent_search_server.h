@@ -0,0 +1,66 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "document.h"
+#include "search_server.h"
+
+const std::chrono::milliseconds PUBLISH_RELEASE_TIMEOUT(100); // столько Publish ждет читателей прежней версии
+
+// Сервер для поиска во время обновлений (схема left-right): индекс хранится в двух экземплярах SearchServer.
+// Читатели берут опубликованный экземпляр через GetSnapshot и писателя не ждут - снимок не меняется,
+// пока на него есть shared_ptr. Писатель меняет скрытый экземпляр; Publish атомарно публикует его,
+// дожидается, пока прежний отпустят все читатели, и повторяет на нем те же изменения.
+// Снимок лучше отпускать после запроса. Если прежнюю версию держат дольше PUBLISH_RELEASE_TIMEOUT
+// (хоть сам поток, вызвавший Publish), она остается читателям, а писатель продолжает на копии новой версии.
+// Снимок владеет своим экземпляром и остается рабочим и после разрушения ConcurrentSearchServer
+class ConcurrentSearchServer {
+public:
+    template <typename StringContainer>
+    explicit ConcurrentSearchServer(const StringContainer& stop_words, size_t shard_count = 1,
+        PostingFormat posting_format = PostingFormat::PLAIN, WordPositions word_positions = WordPositions::DISCARDED);
+    explicit ConcurrentSearchServer(const std::string& stop_words_text, size_t shard_count = 1,
+        PostingFormat posting_format = PostingFormat::PLAIN, WordPositions word_positions = WordPositions::DISCARDED);
+
+    ConcurrentSearchServer(const ConcurrentSearchServer&) = delete;
+    ConcurrentSearchServer& operator=(const ConcurrentSearchServer&) = delete;
+
+    // опубликованная версия индекса; безопасно вызывать из любого потока
+    std::shared_ptr<const SearchServer> GetSnapshot() const;
+
+    // Изменения проверяются сразу и бросают те же исключения, что у SearchServer,
+    // но читатели увидят их только после Publish. Писатели выполняются по очереди
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+    void AddDocuments(const std::vector<DocumentToAdd>& documents);
+    void RemoveDocument(int document_id);
+    void RemoveDocuments(const std::vector<int>& document_ids);
+    void Publish();
+
+private:
+    std::shared_ptr<SearchServer> servers_[2];
+    size_t hidden_ = 1;  // экземпляр, который сейчас меняет писатель
+    // изменения с прошлого Publish: их надо повторить на втором экземпляре
+    std::vector<std::function<void(SearchServer&)>> pending_changes_;
+    std::mutex writer_mutex_;
+    std::shared_ptr<const SearchServer> published_;  // читается и пишется только через std::atomic_load/atomic_store
+    std::future<void> published_released_;           // готов, когда опубликованную версию отпустят все
+
+    // публикует servers_[index]; возвращает future, готовый, когда отпустят прежнюю версию
+    std::future<void> PublishServer(size_t index);
+    void ApplyChange(std::function<void(SearchServer&)> change);
+};
+
+template <typename StringContainer>
+ConcurrentSearchServer::ConcurrentSearchServer(const StringContainer& stop_words, size_t shard_count,
+    PostingFormat posting_format, WordPositions word_positions)
+    : servers_{ std::make_shared<SearchServer>(stop_words, shard_count, posting_format, word_positions),
+        std::make_shared<SearchServer>(stop_words, shard_count, posting_format, word_positions) } {
+    PublishServer(0);
+}
@@ -1,6 +1,10 @@
 #pragma once
+#include <climits>
+#include <cstddef>
 #include <iostream>
 #include <string>
+#include <string_view>
+#include <vector>
 
 struct Document {
     Document();
@@ -17,3 +21,20 @@ enum class DocumentStatus {
     BANNED,
     REMOVED,
 };
+const size_t DOCUMENT_STATUS_COUNT = 4;
+
+// Отбор документов без произвольного предиката: статус и рейтинг в [min_rating, max_rating].
+// SearchServer проверяет его по битовой маске статуса и столбцу рейтингов прямо при обходе списков вхождений
+struct DocumentFilter {
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    int min_rating = INT_MIN;
+    int max_rating = INT_MAX;
+};
+
+// документ для пакетной загрузки SearchServer::AddDocuments
+struct DocumentToAdd {
+    int id = 0;
+    std::string_view text;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    std::vector<int> ratings;
+};
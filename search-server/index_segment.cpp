@@ -0,0 +1,62 @@
+#include "index_segment.h"
+
+#include <algorithm>
+
+const std::vector<PostingList>* IndexSegment::Find(TermId term_id) const {
+    const auto it = std::lower_bound(term_ids.begin(), term_ids.end(), term_id);
+    return it != term_ids.end() && *it == term_id ? &postings[it - term_ids.begin()] : nullptr;
+}
+
+std::vector<PostingList>* IndexSegment::Find(TermId term_id) {
+    return const_cast<std::vector<PostingList>*>(static_cast<const IndexSegment&>(*this).Find(term_id));
+}
+
+size_t IndexSegment::GetMemoryUsage() const {
+    size_t bytes = term_ids.capacity() * sizeof(TermId) + postings.capacity() * sizeof(std::vector<PostingList>);
+    for (const auto& shard_postings : postings) {
+        bytes += shard_postings.capacity() * sizeof(PostingList);
+        for (const PostingList& shard_posting : shard_postings) {
+            bytes += shard_posting.GetMemoryUsage();
+        }
+    }
+    return bytes;
+}
+
+std::shared_ptr<IndexSegment> MergeSegments(const std::vector<std::shared_ptr<const IndexSegment>>& segments,
+    const std::vector<bool>& is_removed, size_t shard_count, PostingFormat posting_format) {
+    auto merged = std::make_shared<IndexSegment>();
+    merged->first_ordinal = segments.front()->first_ordinal;
+    merged->last_ordinal = segments.back()->last_ordinal;
+    for (const auto& segment : segments) {
+        merged->term_ids.insert(merged->term_ids.end(), segment->term_ids.begin(), segment->term_ids.end());
+    }
+    std::sort(merged->term_ids.begin(), merged->term_ids.end());
+    merged->term_ids.erase(std::unique(merged->term_ids.begin(), merged->term_ids.end()), merged->term_ids.end());
+
+    // сегменты идут по возрастанию номеров, поэтому списки слова просто склеиваются по порядку
+    std::vector<TermId> term_ids;
+    term_ids.reserve(merged->term_ids.size());
+    merged->postings.reserve(merged->term_ids.size());
+    for (const TermId term_id : merged->term_ids) {
+        std::vector<PostingList> shard_postings(shard_count, PostingList(posting_format));
+        bool is_empty = true;
+        for (const auto& segment : segments) {
+            if (const auto* segment_postings = segment->Find(term_id)) {
+                for (size_t shard = 0; shard < shard_count; ++shard) {
+                    shard_postings[shard].AppendFrom((*segment_postings)[shard], is_removed);
+                }
+            }
+        }
+        for (PostingList& postings : shard_postings) {
+            postings.Compact();
+            is_empty = is_empty && postings.empty();
+        }
+        // слово, все документы которого удалены, из сегмента выпадает
+        if (!is_empty) {
+            term_ids.push_back(term_id);
+            merged->postings.push_back(std::move(shard_postings));
+        }
+    }
+    merged->term_ids = std::move(term_ids);
+    return merged;
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "posting_list.h"
+#include "term_dictionary.h"
+
+// Часть индекса со списками вхождений документов с номерами из [first_ordinal, last_ordinal).
+// После сброса из буфера SearchServer сегмент не дополняется: новые документы идут в следующий,
+// а соседние сегменты сливаются в один в фоне (MergeSegments)
+struct IndexSegment {
+    uint32_t first_ordinal = 0;
+    uint32_t last_ordinal = 0;
+    std::vector<TermId> term_ids;                    // по возрастанию
+    std::vector<std::vector<PostingList>> postings;  // postings[i][shard] - списки слова term_ids[i]
+
+    // списки слова по шардам или nullptr, если слова в сегменте нет
+    const std::vector<PostingList>* Find(TermId term_id) const;
+    std::vector<PostingList>* Find(TermId term_id);
+    // байт в куче под списки вхождений
+    size_t GetMemoryUsage() const;
+};
+
+// Сливает соседние сегменты, переданные по возрастанию номеров, в один.
+// Вхождения документов, отмеченных в is_removed, в результат не попадают
+std::shared_ptr<IndexSegment> MergeSegments(const std::vector<std::shared_ptr<const IndexSegment>>& segments,
+    const std::vector<bool>& is_removed, size_t shard_count, PostingFormat posting_format);
@@ -0,0 +1,198 @@
+#include "index_snapshot.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <tuple>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+// отображает файл целиком только на чтение; дескрипторы после отображения не нужны
+std::pair<const char*, size_t> MapFile(const std::string& path) {
+#ifdef _WIN32
+    const HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error("Cannot open snapshot " + path);
+    }
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart < static_cast<LONGLONG>(sizeof(SnapshotHeader))) {
+        CloseHandle(file);
+        throw std::invalid_argument("Snapshot " + path + " is damaged");
+    }
+    const HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (mapping == nullptr) {
+        throw std::runtime_error("Cannot map snapshot " + path);
+    }
+    const void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (data == nullptr) {
+        throw std::runtime_error("Cannot map snapshot " + path);
+    }
+    return { static_cast<const char*>(data), static_cast<size_t>(file_size.QuadPart) };
+#else
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open snapshot " + path);
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size < static_cast<off_t>(sizeof(SnapshotHeader))) {
+        close(fd);
+        throw std::invalid_argument("Snapshot " + path + " is damaged");
+    }
+    const size_t size = static_cast<size_t>(file_stat.st_size);
+    void* data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        throw std::runtime_error("Cannot map snapshot " + path);
+    }
+    return { static_cast<const char*>(data), size };
+#endif
+}
+
+void UnmapFile(const char* data, size_t size) {
+#ifdef _WIN32
+    UnmapViewOfFile(data);
+#else
+    munmap(const_cast<char*>(data), size);
+#endif
+}
+
+// секция из count элементов по element_size байт целиком лежит в файле
+bool IsSectionInside(uint64_t offset, uint64_t count, size_t element_size, size_t file_size) {
+    return offset % 8 == 0 && offset <= file_size && count <= (file_size - offset) / element_size;
+}
+}
+
+MappedIndex::MappedIndex(const std::string& path) {
+    std::tie(data_, size_) = MapFile(path);
+    try {
+        ReadLayout(path);
+    } catch (...) {
+        UnmapFile(data_, size_);
+        throw;
+    }
+}
+
+MappedIndex::~MappedIndex() {
+    UnmapFile(data_, size_);
+}
+
+void MappedIndex::ReadLayout(const std::string& path) {
+    const auto* header = reinterpret_cast<const SnapshotHeader*>(data_);
+    if (std::memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 || header->byte_order_mark != 0x01020304) {
+        throw std::invalid_argument("File " + path + " is not a search index snapshot");
+    }
+    if (header->version != SNAPSHOT_VERSION) {
+        throw std::invalid_argument("Snapshot " + path + " has unsupported version " + std::to_string(header->version));
+    }
+    const bool is_inside = IsSectionInside(header->documents_offset, header->document_count, sizeof(SnapshotDocument), size_)
+        && IsSectionInside(header->terms_offset, header->term_count, sizeof(SnapshotTerm), size_)
+        && IsSectionInside(header->stop_words_offset, header->stop_word_count, sizeof(SnapshotString), size_)
+        && IsSectionInside(header->ordinals_offset, header->posting_count, sizeof(uint32_t), size_)
+        && IsSectionInside(header->term_freqs_offset, header->posting_count, sizeof(double), size_)
+        && IsSectionInside(header->strings_offset, header->string_bytes, 1, size_)
+        && header->document_count <= UINT32_MAX;
+    if (!is_inside) {
+        throw std::invalid_argument("Snapshot " + path + " is damaged");
+    }
+
+    header_ = header;
+    documents_ = reinterpret_cast<const SnapshotDocument*>(data_ + header->documents_offset);
+    terms_ = reinterpret_cast<const SnapshotTerm*>(data_ + header->terms_offset);
+    stop_words_ = reinterpret_cast<const SnapshotString*>(data_ + header->stop_words_offset);
+    ordinals_ = reinterpret_cast<const uint32_t*>(data_ + header->ordinals_offset);
+    term_freqs_ = reinterpret_cast<const double*>(data_ + header->term_freqs_offset);
+    strings_ = data_ + header->strings_offset;
+
+    // Статус уходит в предикат пользователя как DocumentStatus, поэтому проверяем его сразу. Строки, границы
+    // списков и номера документов во вхождениях поиск проверяет там, где читает: открытие не трогает
+    // остальные страницы файла
+    if (!std::all_of(documents_, documents_ + header->document_count, [](const SnapshotDocument& document) {
+        return document.status < DOCUMENT_STATUS_COUNT;
+        })) {
+        throw std::invalid_argument("Snapshot " + path + " is damaged");
+    }
+}
+
+std::vector<Document> MappedIndex::FindTopDocuments(std::string_view raw_query, DocumentStatus status, size_t top_count) const {
+    return FindTopDocuments(raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
+        return document_status == status;
+        }, top_count);
+}
+
+int MappedIndex::GetDocumentCount() const {
+    return static_cast<int>(header_->document_count);
+}
+
+std::string_view MappedIndex::GetString(const SnapshotString& string) const {
+    if (string.offset > header_->string_bytes || string.length > header_->string_bytes - string.offset) {
+        throw std::invalid_argument("Snapshot is damaged");
+    }
+    return { strings_ + string.offset, static_cast<size_t>(string.length) };
+}
+
+bool MappedIndex::IsStopWord(std::string_view word) const {
+    const SnapshotString* last = stop_words_ + header_->stop_word_count;
+    const SnapshotString* it = std::lower_bound(stop_words_, last, word, [this](const SnapshotString& string, std::string_view word) {
+        return GetString(string) < word;
+        });
+    return it != last && GetString(*it) == word;
+}
+
+const SnapshotTerm* MappedIndex::FindTerm(std::string_view word) const {
+    const SnapshotTerm* last = terms_ + header_->term_count;
+    const SnapshotTerm* it = std::lower_bound(terms_, last, word, [this](const SnapshotTerm& term, std::string_view word) {
+        return GetString(term.text) < word;
+        });
+    return it != last && GetString(it->text) == word ? it : nullptr;
+}
+
+MappedIndex::Query MappedIndex::ParseQuery(std::string_view text) const {
+    static thread_local std::vector<std::string_view> words;
+    const size_t first_invalid_word = SplitIntoWords(text, words);
+    std::vector<std::string_view> plus_words;
+    std::vector<std::string_view> minus_words;
+    for (size_t i = 0; i < words.size(); ++i) {
+        std::string_view word = words[i];
+        const bool is_minus = word[0] == '-';
+        if (is_minus) {
+            word.remove_prefix(1);
+        }
+        // управляющие символы уже найдены при разбиении, перепроверяем только слова начиная с первого невалидного
+        if (word.empty() || word[0] == '-' || (i >= first_invalid_word
+            && std::any_of(word.begin(), word.end(), [](char c) { return c >= '\0' && c < ' '; }))) {
+            throw std::invalid_argument("Query word " + std::string(words[i]) + " is invalid");
+        }
+        if (!IsStopWord(word)) {
+            (is_minus ? minus_words : plus_words).push_back(word);
+        }
+    }
+    return { ResolveQueryTerms(plus_words), ResolveQueryTerms(minus_words) };
+}
+
+std::vector<const SnapshotTerm*> MappedIndex::ResolveQueryTerms(std::vector<std::string_view>& words) const {
+    std::sort(words.begin(), words.end());
+    words.erase(std::unique(words.begin(), words.end()), words.end());
+    std::vector<const SnapshotTerm*> terms;
+    terms.reserve(words.size());
+    for (const std::string_view word : words) {
+        if (const SnapshotTerm* term = FindTerm(word)) {
+            if (term->first_posting > header_->posting_count || term->posting_count > header_->posting_count - term->first_posting) {
+                throw std::invalid_argument("Snapshot is damaged");
+            }
+            terms.push_back(term);
+        }
+    }
+    return terms;
+}
@@ -0,0 +1,135 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "document.h"
+#include "relevance_accumulator.h"
+#include "search_server.h"
+#include "top_documents.h"
+
+// Формат файла снимка индекса (SearchServer::SaveSnapshot). Все секции выровнены на 8 байт,
+// числа записаны в порядке байт машины, которая сохраняла снимок
+const char SNAPSHOT_MAGIC[8] = { 'S', 'R', 'C', 'H', 'I', 'D', 'X', '\0' };
+const uint32_t SNAPSHOT_VERSION = 1;
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order_mark;  // 0x01020304 при записи
+    uint64_t document_count;
+    uint64_t term_count;
+    uint64_t stop_word_count;
+    uint64_t posting_count;
+    uint64_t string_bytes;
+    uint64_t documents_offset;   // SnapshotDocument[document_count] по порядку номеров
+    uint64_t terms_offset;       // SnapshotTerm[term_count] по возрастанию слова
+    uint64_t stop_words_offset;  // SnapshotString[stop_word_count] по возрастанию
+    uint64_t ordinals_offset;    // uint32_t[posting_count]: номера документов из вхождений всех слов подряд
+    uint64_t term_freqs_offset;  // double[posting_count]: tf тех же вхождений
+    uint64_t strings_offset;     // char[string_bytes]: тексты слов и стоп-слов
+};
+
+struct SnapshotDocument {
+    int32_t id;
+    int32_t rating;
+    uint32_t status;
+};
+
+struct SnapshotString {
+    uint64_t offset;  // от начала секции строк
+    uint64_t length;
+};
+
+struct SnapshotTerm {
+    SnapshotString text;
+    uint64_t first_posting;
+    uint64_t posting_count;
+    double inverse_document_freq;  // IDF на момент сохранения
+};
+
+// Индекс, открытый из снимка через mmap. Ничего не перестраивает в памяти: слова ищутся
+// двоичным поиском прямо по отображенному файлу, списки вхождений читаются оттуда же.
+// Страницы файла общие для всех процессов, открывших один снимок. Только чтение.
+// Позиций слов в снимке нет: фраз в кавычках нет, кавычка - обычный символ слова
+class MappedIndex {
+public:
+    explicit MappedIndex(const std::string& path);
+    ~MappedIndex();
+
+    MappedIndex(const MappedIndex&) = delete;
+    MappedIndex& operator=(const MappedIndex&) = delete;
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate,
+        size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL,
+        size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    int GetDocumentCount() const;
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    const SnapshotHeader* header_ = nullptr;
+    const SnapshotDocument* documents_ = nullptr;
+    const SnapshotTerm* terms_ = nullptr;
+    const SnapshotString* stop_words_ = nullptr;
+    const uint32_t* ordinals_ = nullptr;
+    const double* term_freqs_ = nullptr;
+    const char* strings_ = nullptr;
+
+    struct Query {
+        std::vector<const SnapshotTerm*> plus_terms;
+        std::vector<const SnapshotTerm*> minus_terms;
+    };
+
+    // проверяет заголовок, границы секций и статусы документов, расставляет указатели на секции
+    void ReadLayout(const std::string& path);
+    std::string_view GetString(const SnapshotString& string) const;
+    bool IsStopWord(std::string_view word) const;
+    const SnapshotTerm* FindTerm(std::string_view word) const;
+    // те же правила и исключения, что у SearchServer::ParseQuery
+    Query ParseQuery(std::string_view text) const;
+    std::vector<const SnapshotTerm*> ResolveQueryTerms(std::vector<std::string_view>& words) const;
+};
+
+template <typename DocumentPredicate>
+std::vector<Document> MappedIndex::FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate,
+    size_t top_count) const {
+    const Query query = ParseQuery(raw_query);
+    RelevanceAccumulator& document_to_relevance = GetThreadRelevanceAccumulator();
+    const uint64_t document_count = header_->document_count;
+    document_to_relevance.Reset(document_count);
+    // номера документов из файла проверяются при чтении: открытие списки вхождений не просматривает
+    for (const SnapshotTerm* term : query.minus_terms) {
+        for (uint64_t i = term->first_posting; i < term->first_posting + term->posting_count; ++i) {
+            if (ordinals_[i] >= document_count) {
+                throw std::invalid_argument("Snapshot is damaged");
+            }
+            document_to_relevance.Exclude(ordinals_[i]);
+        }
+    }
+    // слова и документы обходятся в том же порядке, что в SearchServer, - суммы релевантности совпадают до бита
+    for (const SnapshotTerm* term : query.plus_terms) {
+        for (uint64_t i = term->first_posting; i < term->first_posting + term->posting_count; ++i) {
+            if (ordinals_[i] >= document_count) {
+                throw std::invalid_argument("Snapshot is damaged");
+            }
+            if (!document_to_relevance.IsExcluded(ordinals_[i])) {
+                document_to_relevance.Add(ordinals_[i], term_freqs_[i] * term->inverse_document_freq);
+            }
+        }
+    }
+    TopDocuments matched_documents(top_count);
+    for (const uint32_t ordinal : document_to_relevance.GetTouched()) {
+        const SnapshotDocument& document = documents_[ordinal];
+        if (document_predicate(document.id, static_cast<DocumentStatus>(document.status), document.rating)) {
+            matched_documents.Push({ document.id, document_to_relevance.GetRelevance(ordinal), document.rating });
+        }
+    }
+    return matched_documents.Extract();
+}
@@ -1,7 +1,14 @@
+#include <atomic>
+#include <cmath>
+#include <cstdio>
 #include <execution>
 #include <iostream>
+#include <map>
+#include <optional>
 #include <random>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 #include <random>
 
@@ -9,6 +16,8 @@
 #include "search_server.h"
 //#include "Test.h"
 #include "process_queries.h"
+#include "index_snapshot.h"
+#include "concurrent_search_server.h"
 
 using namespace std;
 
@@ -70,6 +79,379 @@ void Test(string_view mark, const SearchServer& search_server, const vector<stri
 
 #define TEST(policy) Test(#policy, search_server, queries, execution::policy)
 
+// сравнение старой раскладки индекса (map<слово, map<id, tf>>) с плоскими списками PostingList
+void BenchmarkPostingLayout(const vector<string>& documents, const vector<string>& queries) {
+    map<string, map<int, double>> nested_index;
+    unordered_map<string, PostingList> flat_index;
+    for (size_t i = 0; i < documents.size(); ++i) {
+        const auto words = SplitIntoWords(documents[i]);
+        map<string_view, uint32_t> word_counts;
+        for (const string_view word : words) {
+            ++word_counts[word];
+        }
+        for (const auto& [word, count] : word_counts) {
+            nested_index[string(word)][i] = ComputeTermFreq(count, words.size());
+            flat_index[string(word)].Add(i, count, words.size());
+        }
+    }
+
+    // накопитель одинаковый, меряем только обход индекса
+    vector<double> document_to_relevance(documents.size());
+    double nested_total = 0;
+    {
+        LOG_DURATION("nested map index"s);
+        for (const string& query : queries) {
+            for (const string_view word : SplitIntoWords(query)) {
+                const auto it = nested_index.find(string(word));
+                if (it == nested_index.end()) {
+                    continue;
+                }
+                for (const auto [document_id, term_freq] : it->second) {
+                    document_to_relevance[document_id] += term_freq;
+                }
+            }
+            for (double& relevance : document_to_relevance) {
+                nested_total += relevance;
+                relevance = 0;
+            }
+        }
+    }
+    double flat_total = 0;
+    {
+        LOG_DURATION("flat posting lists"s);
+        for (const string& query : queries) {
+            for (const string_view word : SplitIntoWords(query)) {
+                const auto it = flat_index.find(string(word));
+                if (it == flat_index.end()) {
+                    continue;
+                }
+                it->second.ForEach([&document_to_relevance](uint32_t document_id, double term_freq) {
+                    document_to_relevance[document_id] += term_freq;
+                    });
+            }
+            for (double& relevance : document_to_relevance) {
+                flat_total += relevance;
+                relevance = 0;
+            }
+        }
+    }
+    cout << nested_total << " "s << flat_total << endl;
+}
+
+// Поиск на ConcurrentSearchServer без записи и под записью: писатель в отдельном потоке добавляет
+// документы пачками по UPDATE_BATCH_SIZE и публикует каждую. Разорванное чтение - снимок, в котором
+// число документов не кратно пачке, или найденный документ, которого в снимке нет
+void BenchmarkConcurrentUpdates(const string& stop_words, const vector<string>& documents, const vector<string>& queries) {
+    const size_t UPDATE_BATCH_SIZE = 100;
+    ConcurrentSearchServer server(stop_words);
+    vector<DocumentToAdd> batch;
+    for (size_t i = 0; i < documents.size() / 2; ++i) {
+        batch.push_back({ static_cast<int>(i), documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 } });
+    }
+    server.AddDocuments(batch);
+    server.Publish();
+
+    auto run_queries = [&server, &queries]() {
+        size_t torn_reads = 0;
+        for (const string& query : queries) {
+            const auto snapshot = server.GetSnapshot();
+            const int document_count = snapshot->GetDocumentCount();
+            if (document_count % UPDATE_BATCH_SIZE != 0) {
+                ++torn_reads;
+            }
+            for (const Document& document : snapshot->FindTopDocuments(query)) {
+                if (document.id >= document_count) {
+                    ++torn_reads;
+                }
+            }
+        }
+        return torn_reads;
+    };
+    {
+        LOG_DURATION("concurrent read"s);
+        run_queries();
+    }
+
+    atomic<bool> is_done = false;
+    thread writer([&]() {
+        for (size_t first = documents.size() / 2; first < documents.size() && !is_done; first += UPDATE_BATCH_SIZE) {
+            vector<DocumentToAdd> update;
+            for (size_t i = first; i < min(documents.size(), first + UPDATE_BATCH_SIZE); ++i) {
+                update.push_back({ static_cast<int>(i), documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 } });
+            }
+            server.AddDocuments(update);
+            server.Publish();
+        }
+        });
+    size_t torn_reads = 0;
+    {
+        LOG_DURATION("concurrent read under writes"s);
+        torn_reads = run_queries();
+    }
+    is_done = true;
+    writer.join();
+    cout << "torn reads: "s << torn_reads << ", documents after writes: "s << server.GetSnapshot()->GetDocumentCount() << endl;
+}
+
+// MatchDocument каждого документа по очереди против MatchDocuments, который разбирает запрос один раз
+void BenchmarkMatchDocuments(const SearchServer& search_server, const vector<string>& queries) {
+    const vector<int> document_ids(search_server.begin(), search_server.end());
+    const size_t query_count = 10;
+    size_t matched_word_count = 0;
+    {
+        LOG_DURATION("match one by one"s);
+        for (size_t i = 0; i < query_count; ++i) {
+            for (const int document_id : document_ids) {
+                matched_word_count += get<0>(search_server.MatchDocument(queries[i], document_id)).size();
+            }
+        }
+    }
+    size_t batched_word_count = 0;
+    {
+        LOG_DURATION("match batched"s);
+        for (size_t i = 0; i < query_count; ++i) {
+            for (const auto& [words, status] : search_server.MatchDocuments(queries[i], document_ids)) {
+                batched_word_count += words.size();
+            }
+        }
+    }
+    cout << matched_word_count << " "s << batched_word_count << endl;
+}
+
+// ProcessQueries по одному запросу против пачки с общим обходом списков. Запросы берут слова
+// из первых vocabulary_size слов словаря, так что у запросов пачки много общих слов
+void BenchmarkBatchQueries(const SearchServer& search_server, const vector<string>& dictionary) {
+    mt19937 generator(7);
+    for (const size_t vocabulary_size : { size_t{ 100 }, dictionary.size() }) {
+        const vector<string> vocabulary(dictionary.begin(), dictionary.begin() + vocabulary_size);
+        const auto queries = GenerateQueries(generator, vocabulary, 2'000, 10);
+        vector<vector<Document>> results;
+        {
+            LOG_DURATION("queries one by one, vocabulary "s + to_string(vocabulary_size));
+            results = ProcessQueries(search_server, queries);
+        }
+        vector<vector<Document>> batched_results;
+        {
+            LOG_DURATION("batched queries, vocabulary "s + to_string(vocabulary_size));
+            batched_results = ProcessQueriesBatched(search_server, queries);
+        }
+        cout << "same results: "s << (results.size() == batched_results.size()
+            && equal(results.begin(), results.end(), batched_results.begin(), [](const auto& lhs, const auto& rhs) {
+                return equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [](const Document& x, const Document& y) {
+                    return x.id == y.id && x.relevance == y.relevance;
+                    });
+                })) << endl;
+    }
+}
+
+// Перекошенный поток запросов: каждый запрос выбирается из queries с вероятностью, убывающей к концу списка,
+// так что немногие запросы составляют большую часть потока. ProcessQueries без кеша выдачи и с ним
+void BenchmarkResultCache(SearchServer& search_server, const vector<string>& queries) {
+    mt19937 generator(42);
+    uniform_real_distribution<double> distribution(0, 1);
+    vector<string> skewed_queries;
+    for (int i = 0; i < 10'000; ++i) {
+        skewed_queries.push_back(queries[static_cast<size_t>(pow(distribution(generator), 3) * queries.size())]);
+    }
+    {
+        LOG_DURATION("skewed uncached"s);
+        ProcessQueries(search_server, skewed_queries);
+    }
+    auto result_cache = make_shared<ResultCache>(64);
+    search_server.SetResultCache(result_cache);
+    {
+        LOG_DURATION("skewed cached"s);
+        ProcessQueries(search_server, skewed_queries);
+    }
+    search_server.SetResultCache(nullptr);
+    const auto stats = result_cache->GetStats();
+    cout << "cache hits: "s << stats.hits << ", misses: "s << stats.misses << ", evictions: "s << stats.evictions << endl;
+}
+
+// Корпус со смешанными статусами и рейтингами: фильтр по столбцам против той же проверки лямбдой
+void BenchmarkDocumentFilter(const string& stop_words, const vector<string>& documents, const vector<string>& queries) {
+    vector<DocumentToAdd> batch;
+    batch.reserve(documents.size());
+    for (size_t i = 0; i < documents.size(); ++i) {
+        const int id = static_cast<int>(i);
+        batch.push_back({ id, documents[i], static_cast<DocumentStatus>(i % DOCUMENT_STATUS_COUNT), { id % 11, id % 7 } });
+    }
+    SearchServer search_server(stop_words);
+    search_server.AddDocuments(batch);
+
+    const DocumentFilter filter{ DocumentStatus::BANNED, 2, 6 };
+    auto predicate = [&filter](int document_id, DocumentStatus status, int rating) {
+        return status == filter.status && rating >= filter.min_rating && rating <= filter.max_rating;
+    };
+    double total_relevance = 0;
+    {
+        LOG_DURATION("predicate filter"s);
+        for (const string_view query : queries) {
+            for (const auto& document : search_server.FindTopDocuments(query, predicate)) {
+                total_relevance += document.relevance;
+            }
+        }
+    }
+    cout << total_relevance << endl;
+    total_relevance = 0;
+    {
+        LOG_DURATION("column filter"s);
+        for (const string_view query : queries) {
+            for (const auto& document : search_server.FindTopDocuments(query, filter)) {
+                total_relevance += document.relevance;
+            }
+        }
+    }
+    cout << total_relevance << endl;
+}
+
+// Корпус и короткие запросы с перекошенной частотой слов, как в живом тексте: частые слова встречаются
+// почти в каждом документе, и отсечение пропускает их списки. Полный перебор против отсечения
+void BenchmarkPruning(const string& stop_words, const vector<string>& dictionary) {
+    mt19937 generator(7);
+    uniform_real_distribution<double> distribution(0, 1);
+    auto generate_text = [&](int word_count) {
+        string text;
+        for (int i = 0; i < word_count; ++i) {
+            text += dictionary[static_cast<size_t>(pow(distribution(generator), 3) * dictionary.size())];
+            text.push_back(' ');
+        }
+        return text;
+    };
+    vector<string> texts;
+    for (int i = 0; i < 20'000; ++i) {
+        texts.push_back(generate_text(70));
+    }
+    vector<DocumentToAdd> batch;
+    for (size_t i = 0; i < texts.size(); ++i) {
+        batch.push_back({ static_cast<int>(i), texts[i], DocumentStatus::ACTUAL, { 1 } });
+    }
+    SearchServer search_server(stop_words);
+    search_server.AddDocuments(batch);
+    vector<string> queries;
+    for (int i = 0; i < 1'000; ++i) {
+        queries.push_back(generate_text(3));
+    }
+    for (const bool is_pruning_enabled : { false, true }) {
+        search_server.SetPruning(is_pruning_enabled);
+        double total_relevance = 0;
+        {
+            LOG_DURATION(is_pruning_enabled ? "skewed words pruned"s : "skewed words exhaustive"s);
+            for (const string_view query : queries) {
+                for (const auto& document : search_server.FindTopDocuments(query)) {
+                    total_relevance += document.relevance;
+                }
+            }
+        }
+        cout << total_relevance << endl;
+    }
+}
+
+// Цена формулы релевантности: один и тот же поиск с TfIdfScorer и Bm25Scorer, с отсечением и без
+template <typename Scorer>
+void BenchmarkScorer(const string& mark, SearchServer& search_server, const vector<string>& queries, const Scorer& scorer) {
+    for (const bool is_pruning_enabled : { true, false }) {
+        search_server.SetPruning(is_pruning_enabled);
+        double total_relevance = 0;
+        {
+            LOG_DURATION(mark + (is_pruning_enabled ? " pruned"s : " exhaustive"s));
+            for (const string_view query : queries) {
+                for (const auto& document : search_server.FindTopDocuments(query, DocumentFilter{}, scorer)) {
+                    total_relevance += document.relevance;
+                }
+            }
+        }
+        cout << total_relevance << endl;
+    }
+    search_server.SetPruning(true);
+}
+
+// Позиции слов: цена загрузки и памяти с ними и без них, поиск фраз из двух соседних слов документов
+void BenchmarkWordPositions(const string& stop_words, const vector<DocumentToAdd>& batch) {
+    SearchServer plain_server(stop_words);
+    {
+        LOG_DURATION("load without positions"s);
+        plain_server.AddDocuments(batch);
+    }
+    SearchServer positional_server(stop_words, 1, PostingFormat::PLAIN, WordPositions::STORED);
+    {
+        LOG_DURATION("load with positions"s);
+        positional_server.AddDocuments(batch);
+    }
+    cout << "position bytes per document: "s << positional_server.GetWordPositionMemoryUsage() / batch.size() << endl;
+
+    vector<string> phrase_queries;
+    for (size_t i = 0; i < batch.size(); i += batch.size() / 100) {
+        const auto words = SplitIntoWords(batch[i].text);
+        if (words.size() >= 2) {
+            phrase_queries.push_back("\""s + string(words[0]) + " "s + string(words[1]) + "\""s);
+        }
+    }
+    size_t document_count = 0;
+    {
+        LOG_DURATION("phrase seq"s);
+        for (const string_view query : phrase_queries) {
+            document_count += positional_server.FindTopDocuments(query).size();
+        }
+    }
+    cout << document_count << endl;
+}
+
+// Загрузка по одному документу в сегментированный индекс: буфер сбрасывается в сегменты, которые сливаются
+// в фоне. Корпус повторяется copy_count раз под новыми id, чтобы слияния дошли до второго уровня
+void BenchmarkSegments(const string& stop_words, const vector<string>& documents, const vector<string>& queries) {
+    const int copy_count = 8;
+    SearchServer segmented_server(stop_words);
+    {
+        LOG_DURATION("segmented load"s);
+        for (int copy = 0; copy < copy_count; ++copy) {
+            for (size_t i = 0; i < documents.size(); ++i) {
+                segmented_server.AddDocument(copy * static_cast<int>(documents.size()) + static_cast<int>(i), documents[i],
+                    DocumentStatus::ACTUAL, { 1, 2, 3 });
+            }
+        }
+        segmented_server.WaitForMerges();
+    }
+    cout << "segments: "s << segmented_server.GetSegmentCount() << endl;
+    Test("segmented seq"s, segmented_server, queries, execution::seq);
+}
+
+// разбиение документов на слова: find + отдельная проверка символов против однопроходного SplitIntoWords
+void BenchmarkTokenizer(const vector<string>& documents) {
+    size_t find_word_count = 0;
+    {
+        LOG_DURATION("find tokenizer"s);
+        for (string_view str : documents) {
+            vector<string_view> words;
+            str.remove_prefix(min(str.size(), str.find_first_not_of(' ')));
+            while (!str.empty()) {
+                const size_t space_pos = str.find(' ');
+                words.push_back(str.substr(0, space_pos));
+                str.remove_prefix(min(str.size(), space_pos));
+                str.remove_prefix(min(str.size(), str.find_first_not_of(' ')));
+            }
+            for (const string_view word : words) {
+                if (any_of(word.begin(), word.end(), [](char c) { return c >= '\0' && c < ' '; })) {
+                    return;
+                }
+            }
+            find_word_count += words.size();
+        }
+    }
+    size_t block_word_count = 0;
+    {
+        LOG_DURATION("block tokenizer"s);
+        vector<string_view> words;
+        for (const string& document : documents) {
+            if (SplitIntoWords(document, words) != NO_INVALID_WORD) {
+                return;
+            }
+            block_word_count += words.size();
+        }
+    }
+    cout << find_word_count << " "s << block_word_count << endl;
+}
+
 int main() {
     mt19937 generator;
 
@@ -77,12 +459,99 @@ int main() {
     const auto documents = GenerateQueries(generator, dictionary, 10'000, 70);
 
     SearchServer search_server(dictionary[0]);
+    {
+        LOG_DURATION("bulk load"s);
+        search_server.BeginBulkLoad();
+        for (size_t i = 0; i < documents.size(); ++i) {
+            search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+        }
+        search_server.CommitBulkLoad();
+    }
+
+    // тот же корпус одним пакетом
+    vector<DocumentToAdd> batch;
+    batch.reserve(documents.size());
     for (size_t i = 0; i < documents.size(); ++i) {
-        search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+        batch.push_back({ static_cast<int>(i), documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 } });
+    }
+    SearchServer batch_server(dictionary[0]);
+    {
+        LOG_DURATION("batch load"s);
+        batch_server.AddDocuments(batch);
     }
 
+    const auto term_stats = search_server.GetTermDictionaryStats();
+    cout << "terms: "s << term_stats.term_count << ", arena "s << term_stats.used_bytes << "/"s << term_stats.arena_bytes
+        << " bytes, lookup "s << term_stats.lookup_bytes << " bytes"s << endl;
+
     const auto queries = GenerateQueries(generator, dictionary, 100, 70);
 
     TEST(seq);
     TEST(par);
+    Test("batch seq"s, batch_server, queries, execution::seq);
+    // тот же запрос без отсечения по верхним границам
+    batch_server.SetPruning(false);
+    Test("exhaustive seq"s, batch_server, queries, execution::seq);
+    batch_server.SetPruning(true);
+
+    // тот же корпус со сжатыми списками вхождений
+    SearchServer compressed_server(dictionary[0], 1, PostingFormat::COMPRESSED);
+    compressed_server.AddDocuments(batch);
+    Test("compressed seq"s, compressed_server, queries, execution::seq);
+    cout << "posting bytes per document: plain "s << batch_server.GetPostingMemoryUsage() / documents.size()
+        << ", compressed "s << compressed_server.GetPostingMemoryUsage() / documents.size() << endl;
+
+    // тот же корпус в индексе, разбитом на шарды по числу ядер
+    SearchServer sharded_server(dictionary[0], max(1u, thread::hardware_concurrency()));
+    sharded_server.AddDocuments(batch);
+    Test("sharded par"s, sharded_server, queries, execution::par);
+    const auto worker_stats = sharded_server.GetThreadPool().GetWorkerStats();
+    for (size_t i = 0; i < worker_stats.size(); ++i) {
+        cout << "worker "s << i << ": executed "s << worker_stats[i].executed
+            << ", stolen "s << worker_stats[i].stolen << ", queued "s << worker_stats[i].queued << endl;
+    }
+
+    // холодный старт со снимка вместо повторной загрузки документов
+    search_server.SaveSnapshot("search_server.snapshot"s);
+    {
+        optional<MappedIndex> mapped_index;
+        {
+            LOG_DURATION("snapshot open"s);
+            mapped_index.emplace("search_server.snapshot"s);
+        }
+        LOG_DURATION("snapshot seq"s);
+        double total_relevance = 0;
+        for (const string_view query : queries) {
+            for (const auto& document : mapped_index->FindTopDocuments(query)) {
+                total_relevance += document.relevance;
+            }
+        }
+        cout << total_relevance << endl;
+    }
+    remove("search_server.snapshot");
+
+    // удаление каждого десятого документа: пометки и одна очистка списков в конце
+    vector<int> removed_ids;
+    for (int id = 0; id < static_cast<int>(documents.size()); id += 10) {
+        removed_ids.push_back(id);
+    }
+    {
+        LOG_DURATION("batch remove"s);
+        batch_server.RemoveDocuments(removed_ids);
+        batch_server.PurgeRemovedDocuments();
+    }
+    Test("after remove seq"s, batch_server, queries, execution::seq);
+
+    BenchmarkPostingLayout(documents, queries);
+    BenchmarkConcurrentUpdates(dictionary[0], documents, queries);
+    BenchmarkSegments(dictionary[0], documents, queries);
+    BenchmarkMatchDocuments(search_server, queries);
+    BenchmarkBatchQueries(search_server, dictionary);
+    BenchmarkResultCache(search_server, queries);
+    BenchmarkDocumentFilter(dictionary[0], documents, queries);
+    BenchmarkScorer("tf-idf"s, batch_server, queries, TfIdfScorer{});
+    BenchmarkScorer("bm25"s, batch_server, queries, Bm25Scorer(1.2, 0.75));
+    BenchmarkPruning(dictionary[0], dictionary);
+    BenchmarkWordPositions(dictionary[0], batch);
+    BenchmarkTokenizer(documents);
 }
\ No newline at end of file
@@ -0,0 +1,540 @@
+#include "posting_list.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SEARCH_SERVER_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+// после упакованных блоков всегда лежат столько нулевых байт: распаковка читает по 8 байт
+const size_t DATA_PADDING = 8;
+
+bool PostingOrdinalLess(const Posting& posting, uint32_t ordinal) {
+    return posting.ordinal < ordinal;
+}
+
+uint8_t GetBitWidth(uint32_t value) {
+    uint8_t bits = 0;
+    for (; value != 0; value >>= 1) {
+        ++bits;
+    }
+    return bits;
+}
+
+// пишет значения подряд, младшими битами вперед
+class BitWriter {
+public:
+    explicit BitWriter(std::vector<uint8_t>& bytes)
+        : bytes_(bytes) {
+    }
+
+    void Write(uint32_t value, uint8_t bits) {
+        buffer_ |= static_cast<uint64_t>(value) << buffered_bits_;
+        buffered_bits_ += bits;
+        for (; buffered_bits_ >= 8; buffered_bits_ -= 8) {
+            bytes_.push_back(static_cast<uint8_t>(buffer_));
+            buffer_ >>= 8;
+        }
+    }
+
+    void Flush() {
+        if (buffered_bits_ > 0) {
+            bytes_.push_back(static_cast<uint8_t>(buffer_));
+        }
+        buffer_ = 0;
+        buffered_bits_ = 0;
+    }
+
+private:
+    std::vector<uint8_t>& bytes_;
+    uint64_t buffer_ = 0;
+    uint8_t buffered_bits_ = 0;
+};
+
+// 8 байт как little-endian число
+uint64_t LoadWord(const uint8_t* bytes) {
+#if (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) || defined(_M_X64) || defined(_M_IX86)
+    uint64_t word;
+    std::memcpy(&word, bytes, sizeof(word));
+    return word;
+#else
+    uint64_t word = 0;
+    for (int i = 7; i >= 0; --i) {
+        word = (word << 8) | bytes[i];
+    }
+    return word;
+#endif
+}
+
+// count значений по bits бит, начиная с бита bit_pos. Без ветвлений: каждое значение
+// достается из одного 8-байтового слова
+void UnpackBits(const uint8_t* data, size_t bit_pos, uint8_t bits, size_t count, uint32_t* values) {
+    if (bits == 0) {
+        std::fill(values, values + count, 0);
+        return;
+    }
+    const uint64_t mask = (uint64_t{ 1 } << bits) - 1;
+    for (size_t i = 0; i < count; ++i, bit_pos += bits) {
+        values[i] = static_cast<uint32_t>((LoadWord(data + (bit_pos >> 3)) >> (bit_pos & 7)) & mask);
+    }
+}
+
+// ordinals[0] = first_ordinal, ordinals[i] = ordinals[i - 1] + deltas[i - 1] + 1
+void RestoreOrdinals(uint32_t first_ordinal, const uint32_t* deltas, size_t count, uint32_t* ordinals) {
+    ordinals[0] = first_ordinal;
+    size_t i = 1;
+#ifdef SEARCH_SERVER_SSE2
+    // префиксная сумма по четыре номера: два сдвига внутри регистра и перенос последнего номера дальше
+    const __m128i one = _mm_set1_epi32(1);
+    __m128i carry = _mm_set1_epi32(static_cast<int>(first_ordinal));
+    for (; i + 4 <= count; i += 4) {
+        __m128i sums = _mm_add_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(deltas + i - 1)), one);
+        sums = _mm_add_epi32(sums, _mm_slli_si128(sums, 4));
+        sums = _mm_add_epi32(sums, _mm_slli_si128(sums, 8));
+        sums = _mm_add_epi32(sums, carry);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(ordinals + i), sums);
+        carry = _mm_shuffle_epi32(sums, _MM_SHUFFLE(3, 3, 3, 3));
+    }
+#endif
+    for (; i < count; ++i) {
+        ordinals[i] = ordinals[i - 1] + deltas[i - 1] + 1;
+    }
+}
+
+// tf слов, встретившихся в документе по одному разу: 1 / длина документа
+void InvertLengths(const uint32_t* lengths, size_t count, double* term_freqs) {
+    size_t i = 0;
+#ifdef SEARCH_SERVER_SSE2
+    const __m128d one = _mm_set1_pd(1.0);
+    for (; i + 2 <= count; i += 2) {
+        const __m128d length = _mm_cvtepi32_pd(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(lengths + i)));
+        _mm_storeu_pd(term_freqs + i, _mm_div_pd(one, length));
+    }
+#endif
+    for (; i < count; ++i) {
+        term_freqs[i] = 1.0 / lengths[i];
+    }
+}
+}
+
+double ComputeTermFreq(uint32_t count, uint32_t document_length) {
+    const double inv_word_count = 1.0 / document_length;
+    double term_freq = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        term_freq += inv_word_count;
+    }
+    return term_freq;
+}
+
+PostingList::PostingList(PostingFormat format)
+    : format_(format) {
+}
+
+void PostingList::Add(uint32_t ordinal, uint32_t count, uint32_t document_length) {
+    if (format_ == PostingFormat::PLAIN) {
+        const double term_freq = ComputeTermFreq(count, document_length);
+        // номера выдаются по возрастанию, поэтому обычно просто дописываем в конец
+        if (postings_.empty() || postings_.back().ordinal < ordinal) {
+            postings_.push_back({ ordinal, term_freq });
+            ++size_;
+            return;
+        }
+        auto it = std::lower_bound(postings_.begin(), postings_.end(), ordinal, PostingOrdinalLess);
+        if (it != postings_.end() && it->ordinal == ordinal) {
+            it->term_freq = term_freq;
+            return;
+        }
+        postings_.insert(it, { ordinal, term_freq });
+        ++size_;
+        return;
+    }
+
+    const bool is_last = empty()
+        || (!tail_.empty() ? tail_.back().ordinal < ordinal : blocks_.back().last_ordinal < ordinal);
+    if (is_last) {
+        tail_.push_back({ ordinal, count, document_length });
+        ++size_;
+        if (tail_.size() == BLOCK_SIZE) {
+            ReplaceBlocks(blocks_.size(), blocks_.size(), tail_);
+            tail_.clear();
+        }
+        return;
+    }
+    // вставка в середину списка - редкость, перепаковываем его целиком
+    std::vector<RawPosting> postings(size_);
+    RawPosting* next = postings.data();
+    for (const Block& block : blocks_) {
+        DecodeBlock(block, next);
+        next += block.size;
+    }
+    std::copy(tail_.begin(), tail_.end(), next);
+    auto it = std::lower_bound(postings.begin(), postings.end(), ordinal, [](const RawPosting& posting, uint32_t ordinal) {
+        return posting.ordinal < ordinal;
+        });
+    if (it != postings.end() && it->ordinal == ordinal) {
+        *it = { ordinal, count, document_length };
+    } else {
+        postings.insert(it, { ordinal, count, document_length });
+        ++size_;
+    }
+    tail_.clear();
+    ReplaceBlocks(0, blocks_.size(), postings);
+}
+
+bool PostingList::Erase(uint32_t ordinal) {
+    if (format_ == PostingFormat::PLAIN) {
+        auto it = std::lower_bound(postings_.begin(), postings_.end(), ordinal, PostingOrdinalLess);
+        if (it == postings_.end() || it->ordinal != ordinal) {
+            return false;
+        }
+        postings_.erase(it);
+        --size_;
+        return true;
+    }
+
+    if (!tail_.empty() && tail_.front().ordinal <= ordinal) {
+        auto it = std::find_if(tail_.begin(), tail_.end(), [ordinal](const RawPosting& posting) {
+            return posting.ordinal == ordinal;
+            });
+        if (it == tail_.end()) {
+            return false;
+        }
+        tail_.erase(it);
+        --size_;
+        return true;
+    }
+    const auto block = FindBlock(ordinal);
+    if (block == blocks_.end() || block->first_ordinal > ordinal) {
+        return false;
+    }
+    // перепаковываем только блок с этим документом
+    RawPosting postings[BLOCK_SIZE];
+    DecodeBlock(*block, postings);
+    const auto it = std::find_if(postings, postings + block->size, [ordinal](const RawPosting& posting) {
+        return posting.ordinal == ordinal;
+        });
+    if (it == postings + block->size) {
+        return false;
+    }
+    std::vector<RawPosting> rest(postings, it);
+    rest.insert(rest.end(), it + 1, postings + block->size);
+    const size_t block_index = block - blocks_.begin();
+    ReplaceBlocks(block_index, block_index + 1, rest);
+    --size_;
+    return true;
+}
+
+size_t PostingList::Renumber(const std::vector<uint32_t>& new_ordinals) {
+    const size_t old_size = size_;
+    if (format_ == PostingFormat::PLAIN) {
+        size_t kept_size = 0;
+        for (const Posting& posting : postings_) {
+            const uint32_t ordinal = new_ordinals[posting.ordinal];
+            if (ordinal != REMOVED_ORDINAL) {
+                postings_[kept_size++] = { ordinal, posting.term_freq };
+            }
+        }
+        postings_.resize(kept_size);
+        size_ = kept_size;
+        return old_size - size_;
+    }
+
+    bool is_changed = false;
+    auto renumber = [&new_ordinals, &is_changed](std::vector<RawPosting>& postings, const RawPosting& posting) {
+        const uint32_t ordinal = new_ordinals[posting.ordinal];
+        is_changed = is_changed || ordinal != posting.ordinal;
+        if (ordinal != REMOVED_ORDINAL) {
+            postings.push_back({ ordinal, posting.count, posting.document_length });
+        }
+    };
+    std::vector<RawPosting> tail;
+    for (const RawPosting& posting : tail_) {
+        renumber(tail, posting);
+    }
+    tail_ = std::move(tail);
+    // блоки перепаковываются все сразу, только если в них что-то поменялось
+    std::vector<RawPosting> kept;
+    is_changed = false;
+    RawPosting postings[BLOCK_SIZE];
+    for (const Block& block : blocks_) {
+        DecodeBlock(block, postings);
+        for (size_t i = 0; i < block.size; ++i) {
+            renumber(kept, postings[i]);
+        }
+    }
+    if (is_changed) {
+        ReplaceBlocks(0, blocks_.size(), kept);
+    }
+    size_ = kept.size() + tail_.size();
+    return old_size - size_;
+}
+
+void PostingList::AppendFrom(const PostingList& other, const std::vector<bool>& is_removed) {
+    if (format_ == PostingFormat::PLAIN) {
+        std::copy_if(other.postings_.begin(), other.postings_.end(), std::back_inserter(postings_), [&is_removed](const Posting& posting) {
+            return !is_removed[posting.ordinal];
+            });
+        size_ = postings_.size();
+        return;
+    }
+
+    auto append = [this, &is_removed](const RawPosting& posting) {
+        if (is_removed[posting.ordinal]) {
+            return;
+        }
+        tail_.push_back(posting);
+        ++size_;
+        if (tail_.size() == BLOCK_SIZE) {
+            ReplaceBlocks(blocks_.size(), blocks_.size(), tail_);
+            tail_.clear();
+        }
+    };
+    RawPosting postings[BLOCK_SIZE];
+    for (const Block& block : other.blocks_) {
+        other.DecodeBlock(block, postings);
+        std::for_each(postings, postings + block.size, append);
+    }
+    std::for_each(other.tail_.begin(), other.tail_.end(), append);
+}
+
+bool PostingList::Contains(uint32_t ordinal) const {
+    if (format_ == PostingFormat::PLAIN) {
+        const auto it = LowerBound(ordinal);
+        return it != postings_.end() && it->ordinal == ordinal;
+    }
+    if (!tail_.empty() && tail_.front().ordinal <= ordinal) {
+        const auto it = std::lower_bound(tail_.begin(), tail_.end(), ordinal, [](const RawPosting& posting, uint32_t ordinal) {
+            return posting.ordinal < ordinal;
+            });
+        return it != tail_.end() && it->ordinal == ordinal;
+    }
+    const auto block = FindBlock(ordinal);
+    if (block == blocks_.end() || block->first_ordinal > ordinal) {
+        return false;
+    }
+    uint32_t ordinals[BLOCK_SIZE];
+    DecodeOrdinals(*block, ordinals);
+    return std::binary_search(ordinals, ordinals + block->size, ordinal);
+}
+
+void PostingList::Compact() {
+    if (format_ == PostingFormat::COMPRESSED && !tail_.empty()) {
+        ReplaceBlocks(blocks_.size(), blocks_.size(), tail_);
+        tail_.clear();
+    }
+    postings_.shrink_to_fit();
+    blocks_.shrink_to_fit();
+    data_.shrink_to_fit();
+    tail_.shrink_to_fit();
+}
+
+size_t PostingList::GetMemoryUsage() const {
+    return postings_.capacity() * sizeof(Posting) + blocks_.capacity() * sizeof(Block)
+        + data_.capacity() + tail_.capacity() * sizeof(RawPosting);
+}
+
+std::vector<Posting>::const_iterator PostingList::LowerBound(uint32_t ordinal) const {
+    if (ordinal == 0) {
+        return postings_.begin();
+    }
+    return std::lower_bound(postings_.begin(), postings_.end(), ordinal, PostingOrdinalLess);
+}
+
+std::vector<PostingList::Block>::const_iterator PostingList::FindBlock(uint32_t ordinal) const {
+    if (ordinal == 0) {
+        return blocks_.begin();
+    }
+    return std::lower_bound(blocks_.begin(), blocks_.end(), ordinal, [](const Block& block, uint32_t ordinal) {
+        return block.last_ordinal < ordinal;
+        });
+}
+
+void PostingList::DecodeOrdinals(const Block& block, uint32_t* ordinals) const {
+    uint32_t deltas[BLOCK_SIZE];
+    UnpackBits(data_.data() + block.data_offset, 0, block.delta_bits, block.size - 1, deltas);
+    RestoreOrdinals(block.first_ordinal, deltas, block.size, ordinals);
+}
+
+void PostingList::DecodeBlock(const Block& block, uint32_t* ordinals, double* term_freqs) const {
+    DecodeOrdinals(block, ordinals);
+    const uint8_t* data = data_.data() + block.data_offset;
+    const size_t counts_bit_pos = static_cast<size_t>(block.delta_bits) * (block.size - 1);
+    const size_t lengths_bit_pos = counts_bit_pos + static_cast<size_t>(block.count_bits) * block.size;
+    uint32_t lengths[BLOCK_SIZE];
+    UnpackBits(data, lengths_bit_pos, block.length_bits, block.size, lengths);
+    // обычно каждое слово встречается в документе один раз, и count в блоке не хранится вовсе
+    if (block.count_bits == 0) {
+        InvertLengths(lengths, block.size, term_freqs);
+        return;
+    }
+    uint32_t counts[BLOCK_SIZE];
+    UnpackBits(data, counts_bit_pos, block.count_bits, block.size, counts);
+    for (size_t i = 0; i < block.size; ++i) {
+        term_freqs[i] = ComputeTermFreq(counts[i] + 1, lengths[i]);
+    }
+}
+
+void PostingList::DecodeBlock(const Block& block, RawPosting* postings) const {
+    uint32_t ordinals[BLOCK_SIZE];
+    uint32_t counts[BLOCK_SIZE];
+    uint32_t lengths[BLOCK_SIZE];
+    DecodeOrdinals(block, ordinals);
+    const uint8_t* data = data_.data() + block.data_offset;
+    const size_t counts_bit_pos = static_cast<size_t>(block.delta_bits) * (block.size - 1);
+    UnpackBits(data, counts_bit_pos, block.count_bits, block.size, counts);
+    UnpackBits(data, counts_bit_pos + static_cast<size_t>(block.count_bits) * block.size, block.length_bits, block.size, lengths);
+    for (size_t i = 0; i < block.size; ++i) {
+        postings[i] = { ordinals[i], counts[i] + 1, lengths[i] };
+    }
+}
+
+void PostingList::ReplaceBlocks(size_t first_block, size_t last_block, const std::vector<RawPosting>& postings) {
+    std::vector<Block> blocks;
+    std::vector<uint8_t> bytes;
+    for (size_t first = 0; first < postings.size(); first += BLOCK_SIZE) {
+        const size_t last = std::min(postings.size(), first + BLOCK_SIZE);
+        Block block{ postings[first].ordinal, postings[last - 1].ordinal, static_cast<uint32_t>(bytes.size()),
+            static_cast<uint8_t>(last - first), 0, 0, 0 };
+        for (size_t i = first; i < last; ++i) {
+            if (i > first) {
+                block.delta_bits = std::max(block.delta_bits, GetBitWidth(postings[i].ordinal - postings[i - 1].ordinal - 1));
+            }
+            block.count_bits = std::max(block.count_bits, GetBitWidth(postings[i].count - 1));
+            block.length_bits = std::max(block.length_bits, GetBitWidth(postings[i].document_length));
+        }
+        BitWriter writer(bytes);
+        for (size_t i = first + 1; i < last; ++i) {
+            writer.Write(postings[i].ordinal - postings[i - 1].ordinal - 1, block.delta_bits);
+        }
+        for (size_t i = first; i < last; ++i) {
+            writer.Write(postings[i].count - 1, block.count_bits);
+        }
+        for (size_t i = first; i < last; ++i) {
+            writer.Write(postings[i].document_length, block.length_bits);
+        }
+        writer.Flush();
+        blocks.push_back(block);
+    }
+
+    if (data_.empty()) {
+        data_.assign(DATA_PADDING, 0);
+    }
+    const size_t old_begin = first_block < blocks_.size() ? blocks_[first_block].data_offset : data_.size() - DATA_PADDING;
+    const size_t old_end = last_block < blocks_.size() ? blocks_[last_block].data_offset : data_.size() - DATA_PADDING;
+    data_.erase(data_.begin() + old_begin, data_.begin() + old_end);
+    data_.insert(data_.begin() + old_begin, bytes.begin(), bytes.end());
+    for (size_t i = last_block; i < blocks_.size(); ++i) {
+        blocks_[i].data_offset = static_cast<uint32_t>(blocks_[i].data_offset + bytes.size() - (old_end - old_begin));
+    }
+    for (Block& block : blocks) {
+        block.data_offset += static_cast<uint32_t>(old_begin);
+    }
+    blocks_.erase(blocks_.begin() + first_block, blocks_.begin() + last_block);
+    blocks_.insert(blocks_.begin() + first_block, blocks.begin(), blocks.end());
+}
+
+PostingList::Cursor::Cursor(const PostingList& postings, uint32_t first_ordinal)
+    : postings_(&postings) {
+    if (postings.format_ == PostingFormat::PLAIN) {
+        const auto& plain = postings.postings_;
+        chunk_ = plain.data();
+        chunk_size_ = plain.size();
+        position_ = postings.LowerBound(first_ordinal) - plain.begin();
+        return;
+    }
+    LoadChunkWith(first_ordinal);
+}
+
+PostingList::Cursor::Cursor(const Cursor& other) {
+    *this = other;
+}
+
+PostingList::Cursor& PostingList::Cursor::operator=(const Cursor& other) {
+    postings_ = other.postings_;
+    position_ = other.position_;
+    chunk_size_ = other.chunk_size_;
+    next_block_ = other.next_block_;
+    is_tail_loaded_ = other.is_tail_loaded_;
+    if (other.chunk_ == other.block_) {
+        std::copy(other.block_, other.block_ + other.chunk_size_, block_);
+        chunk_ = block_;
+    } else {
+        chunk_ = other.chunk_;
+    }
+    return *this;
+}
+
+void PostingList::Cursor::Seek(uint32_t ordinal) {
+    if (IsEnd() || GetOrdinal() >= ordinal) {
+        return;
+    }
+    if (chunk_[chunk_size_ - 1].ordinal < ordinal) {
+        if (chunk_ == block_) {
+            LoadChunkWith(ordinal);
+        } else {
+            position_ = chunk_size_;
+        }
+        return;
+    }
+    // перескоки обычно короткие: ищем границу удвоением шага от текущего места, потом двоичным поиском
+    size_t step = 1;
+    while (position_ + step < chunk_size_ && chunk_[position_ + step].ordinal < ordinal) {
+        step *= 2;
+    }
+    const Posting* first = chunk_ + position_ + step / 2 + 1;
+    const Posting* last = chunk_ + std::min(position_ + step, chunk_size_ - 1) + 1;
+    position_ = std::lower_bound(first, last, ordinal, PostingOrdinalLess) - chunk_;
+}
+
+void PostingList::Cursor::LoadNextChunk() {
+    position_ = 0;
+    chunk_size_ = 0;
+    if (next_block_ < postings_->blocks_.size()) {
+        LoadBlock(next_block_);
+    } else if (!is_tail_loaded_) {
+        LoadTail();
+    }
+}
+
+void PostingList::Cursor::LoadChunkWith(uint32_t ordinal) {
+    position_ = 0;
+    chunk_size_ = 0;
+    const auto& blocks = postings_->blocks_;
+    const auto block = std::lower_bound(blocks.begin() + std::min(next_block_, blocks.size()), blocks.end(), ordinal,
+        [](const Block& block, uint32_t ordinal) {
+            return block.last_ordinal < ordinal;
+        });
+    if (block != blocks.end()) {
+        LoadBlock(block - blocks.begin());
+    } else if (!is_tail_loaded_ && !postings_->tail_.empty() && postings_->tail_.back().ordinal >= ordinal) {
+        LoadTail();
+    } else {
+        return;
+    }
+    position_ = std::lower_bound(block_, block_ + chunk_size_, ordinal, PostingOrdinalLess) - block_;
+}
+
+void PostingList::Cursor::LoadBlock(size_t block) {
+    uint32_t ordinals[BLOCK_SIZE];
+    double term_freqs[BLOCK_SIZE];
+    postings_->DecodeBlock(postings_->blocks_[block], ordinals, term_freqs);
+    chunk_size_ = postings_->blocks_[block].size;
+    for (size_t i = 0; i < chunk_size_; ++i) {
+        block_[i] = { ordinals[i], term_freqs[i] };
+    }
+    next_block_ = block + 1;
+}
+
+void PostingList::Cursor::LoadTail() {
+    const auto& tail = postings_->tail_;
+    for (size_t i = 0; i < tail.size(); ++i) {
+        block_[i] = { tail[i].ordinal, ComputeTermFreq(tail[i].count, tail[i].document_length) };
+    }
+    chunk_size_ = tail.size();
+    next_block_ = postings_->blocks_.size();
+    is_tail_loaded_ = true;
+}
@@ -0,0 +1,164 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct Posting {
+    uint32_t ordinal;  // порядковый номер документа в SearchServer
+    double term_freq;
+};
+
+// tf слова, которое встретилось count раз в документе из document_length слов.
+// Складывается по одному вхождению, как частоты в AddDocument, поэтому совпадает с ними до бита
+double ComputeTermFreq(uint32_t count, uint32_t document_length);
+
+// номер для PostingList::Renumber: документ удален, его вхождение не нужно
+const uint32_t REMOVED_ORDINAL = UINT32_MAX;
+
+enum class PostingFormat {
+    PLAIN,       // номер документа и готовый tf, 16 байт на вхождение
+    COMPRESSED,  // блоки по 128 вхождений: разности номеров, число вхождений и длина документа упакованы битами
+};
+
+// Список вхождений слова, отсортированный по порядковому номеру документа
+class PostingList {
+public:
+    explicit PostingList(PostingFormat format = PostingFormat::PLAIN);
+
+    void Add(uint32_t ordinal, uint32_t count, uint32_t document_length);
+    bool Erase(uint32_t ordinal);
+    // за один проход переписывает номера документов на new_ordinals[ordinal] и удаляет вхождения, где там
+    // REMOVED_ORDINAL; новые номера должны расти вместе со старыми. Возвращает, сколько вхождений удалено
+    size_t Renumber(const std::vector<uint32_t>& new_ordinals);
+    // дописывает в конец вхождения other (того же формата), кроме отмеченных в is_removed;
+    // номера в other должны быть больше номеров этого списка
+    void AppendFrom(const PostingList& other, const std::vector<bool>& is_removed);
+    bool Contains(uint32_t ordinal) const;
+    // сжатый формат: упаковывает недособранный хвост в блок и отдает лишнюю память
+    void Compact();
+
+    // вызывает function(ordinal, term_freq) по возрастанию номеров из [first_ordinal, last_ordinal)
+    template <typename Function>
+    void ForEachInRange(uint32_t first_ordinal, uint32_t last_ordinal, Function function) const;
+    template <typename Function>
+    void ForEach(Function function) const {
+        ForEachInRange(0, UINT32_MAX, function);
+    }
+
+    size_t size() const {
+        return size_;
+    }
+    bool empty() const {
+        return size_ == 0;
+    }
+    // байт в куче, включая запас вместимости
+    size_t GetMemoryUsage() const;
+
+    static const size_t BLOCK_SIZE = 128;
+
+    // Обход по одному вхождению с перескоком вперед - для вычисления запроса документ за документом.
+    // PLAIN читается прямо из списка, COMPRESSED - распакованными блоками до BLOCK_SIZE вхождений;
+    // список нельзя менять, пока жив курсор
+    class Cursor {
+    public:
+        // встает на первое вхождение с номером не меньше first_ordinal
+        Cursor(const PostingList& postings, uint32_t first_ordinal);
+        // chunk_ может указывать на собственный block_, поэтому копирование перенаправляет его на block_ копии
+        Cursor(const Cursor& other);
+        Cursor& operator=(const Cursor& other);
+
+        bool IsEnd() const {
+            return position_ == chunk_size_;
+        }
+        uint32_t GetOrdinal() const {
+            return chunk_[position_].ordinal;
+        }
+        double GetTermFreq() const {
+            return chunk_[position_].term_freq;
+        }
+        void Next() {
+            if (++position_ == chunk_size_ && chunk_ == block_) {
+                LoadNextChunk();
+            }
+        }
+        // к первому вхождению с номером не меньше ordinal; назад не ходит
+        void Seek(uint32_t ordinal);
+
+    private:
+        const PostingList* postings_;
+        // текущий кусок: у PLAIN - весь список целиком, у COMPRESSED - block_
+        const Posting* chunk_ = block_;
+        size_t position_ = 0;
+        size_t chunk_size_ = 0;
+        size_t next_block_ = 0;  // COMPRESSED
+        bool is_tail_loaded_ = false;
+        Posting block_[BLOCK_SIZE];
+
+        void LoadNextChunk();
+        // COMPRESSED: загружает первый из оставшихся блоков, где есть номер не меньше ordinal, и встает на него
+        void LoadChunkWith(uint32_t ordinal);
+        void LoadBlock(size_t block);
+        void LoadTail();
+    };
+
+private:
+    struct RawPosting {
+        uint32_t ordinal;
+        uint32_t count;
+        uint32_t document_length;
+    };
+    // в data_ подряд лежат size - 1 разностей соседних номеров (минус 1), count - 1 и длины документов,
+    // каждое поле своей ширины в битах
+    struct Block {
+        uint32_t first_ordinal;
+        uint32_t last_ordinal;
+        uint32_t data_offset;
+        uint8_t size;
+        uint8_t delta_bits;
+        uint8_t count_bits;
+        uint8_t length_bits;
+    };
+
+    PostingFormat format_;
+    size_t size_ = 0;
+    std::vector<Posting> postings_;  // PLAIN
+    std::vector<Block> blocks_;      // COMPRESSED
+    std::vector<uint8_t> data_;      // упакованные блоки и 8 нулевых байт в конце для чтения словами
+    std::vector<RawPosting> tail_;   // последние вхождения, которые еще не набрали блок
+
+    std::vector<Posting>::const_iterator LowerBound(uint32_t ordinal) const;
+    std::vector<Block>::const_iterator FindBlock(uint32_t ordinal) const;
+    void DecodeBlock(const Block& block, uint32_t* ordinals, double* term_freqs) const;
+    void DecodeBlock(const Block& block, RawPosting* postings) const;
+    void DecodeOrdinals(const Block& block, uint32_t* ordinals) const;
+    // упаковывает postings и заменяет ими блоки [first_block, last_block)
+    void ReplaceBlocks(size_t first_block, size_t last_block, const std::vector<RawPosting>& postings);
+};
+
+template <typename Function>
+void PostingList::ForEachInRange(uint32_t first_ordinal, uint32_t last_ordinal, Function function) const {
+    if (format_ == PostingFormat::PLAIN) {
+        for (auto it = LowerBound(first_ordinal); it != postings_.end() && it->ordinal < last_ordinal; ++it) {
+            function(it->ordinal, it->term_freq);
+        }
+        return;
+    }
+    uint32_t ordinals[BLOCK_SIZE];
+    double term_freqs[BLOCK_SIZE];
+    for (auto block = FindBlock(first_ordinal); block != blocks_.end() && block->first_ordinal < last_ordinal; ++block) {
+        DecodeBlock(*block, ordinals, term_freqs);
+        const size_t first = std::lower_bound(ordinals, ordinals + block->size, first_ordinal) - ordinals;
+        for (size_t i = first; i < block->size && ordinals[i] < last_ordinal; ++i) {
+            function(ordinals[i], term_freqs[i]);
+        }
+    }
+    for (const RawPosting& posting : tail_) {
+        if (posting.ordinal >= last_ordinal) {
+            break;
+        }
+        if (posting.ordinal >= first_ordinal) {
+            function(posting.ordinal, ComputeTermFreq(posting.count, posting.document_length));
+        }
+    }
+}
@@ -1,28 +1,49 @@
-
 #include "process_queries.h"
 
 std::vector<std::vector<Document>> ProcessQueries(const SearchServer& search_server,
 	const std::vector<std::string>& queries) {
 	std::vector<std::vector<Document>> result(queries.size());
 	
-	std::transform(std::execution::par, queries.begin(), queries.end(), result.begin(), 
-		[&](std::string s) {return search_server.FindTopDocuments(s); });
+	search_server.GetThreadPool().ParallelFor(queries.size(),
+		[&](size_t i) {result[i] = search_server.FindTopDocuments(queries[i]); });
 	return result;
 }
 
+std::vector<std::vector<Document>> ProcessQueriesBatched(
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries) {
+    return search_server.FindTopDocumentsBatch(queries);
+}
+
 std::vector<Document> ProcessQueriesJoined(
     const SearchServer& search_server,
     const std::vector<std::string>& queries) {
-    std::vector<std::vector<Document>> documents(queries.size());
-    std::transform(std::execution::par,
-        queries.begin(), queries.end(), documents.begin(),
-        [&search_server](std::string const & qry) {
-            auto v = search_server.FindTopDocuments(qry);
-            return v;
+    return ProcessQueriesFlat(search_server, queries).documents;
+}
+
+FlatQueryResults ProcessQueriesFlat(
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries) {
+    // у каждого запроса не больше MAX_RESULT_DOCUMENT_COUNT документов - пишем сразу в свой слот общего буфера
+    FlatQueryResults result;
+    result.documents.resize(queries.size() * MAX_RESULT_DOCUMENT_COUNT);
+    std::vector<size_t> counts(queries.size());
+    search_server.GetThreadPool().ParallelFor(queries.size(),
+        [&](size_t i) {
+            const auto documents = search_server.FindTopDocuments(queries[i]);
+            std::copy(documents.begin(), documents.end(),
+                result.documents.begin() + i * MAX_RESULT_DOCUMENT_COUNT);
+            counts[i] = documents.size();
         });
-    std::vector<Document> result;
-    for (auto tmp : documents) {
-        result.insert(result.end(), tmp.begin(),tmp.end());
+
+    // сдвигаем слоты влево, убирая пустые места; порядок запросов сохраняется
+    result.offsets.reserve(queries.size() + 1);
+    result.offsets.push_back(0);
+    for (size_t i = 0; i < queries.size(); ++i) {
+        const auto slot = result.documents.begin() + i * MAX_RESULT_DOCUMENT_COUNT;
+        std::move(slot, slot + counts[i], result.documents.begin() + result.offsets.back());
+        result.offsets.push_back(result.offsets.back() + counts[i]);
     }
+    result.documents.resize(result.offsets.back());
     return result;
-}
\ No newline at end of file
+}
@@ -6,7 +6,11 @@
 #include "search_server.h"
 
 
-
+// результаты пачки запросов в одном буфере: документы запроса i лежат в [offsets[i], offsets[i + 1])
+struct FlatQueryResults {
+    std::vector<Document> documents;
+    std::vector<size_t> offsets;
+};
 
 std::vector<std::vector<Document>> ProcessQueries(
     const SearchServer& search_server,
@@ -14,4 +18,38 @@ std::vector<std::vector<Document>> ProcessQueries(
 
 std::vector<Document> ProcessQueriesJoined(
     const SearchServer& search_server,
-    const std::vector<std::string>& queries);
\ No newline at end of file
+    const std::vector<std::string>& queries);
+
+// то же, что ProcessQueries, но через SearchServer::FindTopDocumentsBatch: запросы с общими словами
+// обходят списки вхождений вместе
+std::vector<std::vector<Document>> ProcessQueriesBatched(
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries);
+
+FlatQueryResults ProcessQueriesFlat(
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries);
+
+// вызывает callback(query_index, documents) строго в порядке запросов.
+// Запросы считаются параллельно окнами, в памяти одновременно только результаты текущего окна
+template <typename Callback>
+void ProcessQueriesStreamed(
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries,
+    Callback callback);
+
+template <typename Callback>
+void ProcessQueriesStreamed(const SearchServer& search_server,
+    const std::vector<std::string>& queries, Callback callback) {
+    ThreadPool& thread_pool = search_server.GetThreadPool();
+    const size_t window_size = std::min(queries.size(), thread_pool.GetConcurrency() * 64);
+    std::vector<std::vector<Document>> window(window_size);
+    for (size_t first = 0; first < queries.size(); first += window_size) {
+        const size_t count = std::min(window_size, queries.size() - first);
+        thread_pool.ParallelFor(count,
+            [&](size_t i) { window[i] = search_server.FindTopDocuments(queries[first + i]); });
+        for (size_t i = 0; i < count; ++i) {
+            callback(first + i, static_cast<const std::vector<Document>&>(window[i]));
+        }
+    }
+}
@@ -0,0 +1,24 @@
+#include "relevance_accumulator.h"
+
+void RelevanceAccumulator::Reset(size_t ordinal_count) {
+    for (uint32_t ordinal : touched_list_) {
+        relevance_[ordinal] = 0;
+        ClearBit(touched_, ordinal);
+    }
+    for (uint32_t ordinal : excluded_list_) {
+        ClearBit(excluded_, ordinal);
+    }
+    touched_list_.clear();
+    excluded_list_.clear();
+
+    if (relevance_.size() < ordinal_count) {
+        relevance_.resize(ordinal_count, 0.0);
+        touched_.resize((ordinal_count + 63) / 64, 0);
+        excluded_.resize((ordinal_count + 63) / 64, 0);
+    }
+}
+
+RelevanceAccumulator& GetThreadRelevanceAccumulator() {
+    static thread_local RelevanceAccumulator accumulator;
+    return accumulator;
+}
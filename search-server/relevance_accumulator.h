@@ -0,0 +1,100 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// номер младшего единичного бита; mask не ноль
+inline uint32_t CountTrailingZeros(uint64_t mask) {
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanForward64(&index, mask);
+    return index;
+#elif defined(__GNUC__)
+    return __builtin_ctzll(mask);
+#else
+    uint32_t index = 0;
+    while ((mask & 1) == 0) {
+        mask >>= 1;
+        ++index;
+    }
+    return index;
+#endif
+}
+
+// Плотный накопитель релевантности по порядковым номерам документов.
+// Живет в thread_local буфере и переиспользуется между запросами, поэтому после прогрева
+// подсчет релевантности не выделяет память. Минус-слова отмечаются в битовой маске
+class RelevanceAccumulator {
+public:
+    // очищает следы прошлого запроса и расширяет буфер под ordinal_count документов
+    void Reset(size_t ordinal_count);
+
+    void Exclude(uint32_t ordinal) {
+        if (!TestBit(excluded_, ordinal)) {
+            SetBit(excluded_, ordinal);
+            excluded_list_.push_back(ordinal);
+        }
+    }
+    bool IsExcluded(uint32_t ordinal) const {
+        return TestBit(excluded_, ordinal);
+    }
+
+    void Add(uint32_t ordinal, double relevance) {
+        if (!TestBit(touched_, ordinal)) {
+            SetBit(touched_, ordinal);
+            touched_list_.push_back(ordinal);
+        }
+        relevance_[ordinal] += relevance;
+    }
+
+    const std::vector<uint32_t>& GetTouched() const {
+        return touched_list_;
+    }
+    double GetRelevance(uint32_t ordinal) const {
+        return relevance_[ordinal];
+    }
+    // вызывает function(ordinal) для затронутых документов из [first_ordinal, last_ordinal) по возрастанию номеров
+    template <typename Function>
+    void ForEachTouchedInRange(uint32_t first_ordinal, uint32_t last_ordinal, Function function) const;
+
+private:
+    std::vector<double> relevance_;
+    std::vector<uint64_t> touched_;
+    std::vector<uint64_t> excluded_;
+    std::vector<uint32_t> touched_list_;
+    std::vector<uint32_t> excluded_list_;
+
+    static bool TestBit(const std::vector<uint64_t>& bits, uint32_t ordinal) {
+        return (bits[ordinal >> 6] >> (ordinal & 63)) & 1;
+    }
+    static void SetBit(std::vector<uint64_t>& bits, uint32_t ordinal) {
+        bits[ordinal >> 6] |= uint64_t{ 1 } << (ordinal & 63);
+    }
+    static void ClearBit(std::vector<uint64_t>& bits, uint32_t ordinal) {
+        bits[ordinal >> 6] &= ~(uint64_t{ 1 } << (ordinal & 63));
+    }
+};
+
+template <typename Function>
+void RelevanceAccumulator::ForEachTouchedInRange(uint32_t first_ordinal, uint32_t last_ordinal, Function function) const {
+    for (uint32_t ordinal = first_ordinal & ~uint32_t{ 63 }; ordinal < last_ordinal; ordinal += 64) {
+        uint64_t bits = touched_[ordinal >> 6];
+        // пустые слова маски пропускаются целиком, в остальных - перескок к следующему единичному биту
+        while (bits != 0) {
+            const uint32_t bit_ordinal = ordinal + CountTrailingZeros(bits);
+            if (bit_ordinal >= last_ordinal) {
+                break;
+            }
+            if (bit_ordinal >= first_ordinal) {
+                function(bit_ordinal);
+            }
+            bits &= bits - 1;
+        }
+    }
+}
+
+// буфер текущего потока
+RelevanceAccumulator& GetThreadRelevanceAccumulator();
@@ -1,36 +1,198 @@
 #include "remove_duplicates.h"
 
-void RemoveDuplicates(SearchServer& search_server) {
-    int flag = 0;
-    std::vector<int> delete_id_list;
-    std::map <int, std::set<std::string>> uniq_documents;
-    for (const auto document_id : search_server) {
-        flag = 0;
-        std::set<std::string> uniq_words;
-        auto words_in_document = search_server.GetWordFrequencies(document_id);
-        for (auto words : words_in_document) { 
-            uniq_words.emplace(words.first);
-        }
-        if (uniq_documents.empty()) {
-            uniq_documents.emplace(document_id, uniq_words);
-            continue;
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace {
+using WordFrequencies = std::map<std::string_view, double>;
+
+const size_t MINHASH_SIZE = 64;
+// вероятность, с которой пара со сходством ровно min_similarity попадает в кандидаты
+const double MIN_CANDIDATE_PROBABILITY = 0.95;
+
+// перемешивание splitmix64: соседние числа дают непохожие хеши
+uint64_t MixHash(uint64_t value) {
+    value += 0x9e3779b97f4a7c15ULL;
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+    return value ^ (value >> 31);
+}
+
+uint64_t HashWord(std::string_view word) {
+    return MixHash(std::hash<std::string_view>{}(word));
+}
+
+// слова в словаре частот отсортированы, поэтому одинаковые наборы дают одинаковый отпечаток
+uint64_t ComputeFingerprint(const WordFrequencies& word_freqs) {
+    uint64_t fingerprint = MixHash(word_freqs.size());
+    for (const auto& [word, freq] : word_freqs) {
+        fingerprint = MixHash(fingerprint ^ HashWord(word));
+    }
+    return fingerprint;
+}
+
+bool HaveSameWords(const WordFrequencies& lhs, const WordFrequencies& rhs) {
+    return lhs.size() == rhs.size() && std::equal(lhs.begin(), lhs.end(), rhs.begin(),
+        [](const auto& lhs_word, const auto& rhs_word) {
+            return lhs_word.first == rhs_word.first;
+        });
+}
+
+double ComputeJaccardSimilarity(const WordFrequencies& lhs, const WordFrequencies& rhs) {
+    size_t common_count = 0;
+    for (auto lhs_it = lhs.begin(), rhs_it = rhs.begin(); lhs_it != lhs.end() && rhs_it != rhs.end();) {
+        if (lhs_it->first < rhs_it->first) {
+            ++lhs_it;
+        } else if (rhs_it->first < lhs_it->first) {
+            ++rhs_it;
+        } else {
+            ++common_count;
+            ++lhs_it;
+            ++rhs_it;
         }
-        else {
-            for (auto docs : uniq_documents) {
-                if (uniq_words == docs.second) {
-                    delete_id_list.push_back(document_id);
-                    std::cout << "Found duplicate document id " << document_id << std::endl;
-                    flag = 1;
-                    break;
-                }
-            }
+    }
+    const size_t union_count = lhs.size() + rhs.size() - common_count;
+    return union_count == 0 ? 1.0 : static_cast<double>(common_count) / union_count;
+}
+
+// MinHash: для каждой из MINHASH_SIZE хеш-функций вида a * hash + b (по модулю 2^64)
+// подпись хранит минимум по словам документа
+struct MinHashFunctions {
+    std::array<uint64_t, MINHASH_SIZE> multipliers;
+    std::array<uint64_t, MINHASH_SIZE> increments;
+
+    MinHashFunctions() {
+        for (size_t i = 0; i < MINHASH_SIZE; ++i) {
+            multipliers[i] = MixHash(i) | 1;
+            increments[i] = MixHash(MINHASH_SIZE + i);
         }
-        if (flag != 1) {
-            uniq_documents.emplace(document_id, uniq_words);
+    }
+};
+
+std::array<uint64_t, MINHASH_SIZE> ComputeMinHash(const WordFrequencies& word_freqs) {
+    static const MinHashFunctions functions;
+    std::array<uint64_t, MINHASH_SIZE> signature;
+    signature.fill(UINT64_MAX);
+    for (const auto& [word, freq] : word_freqs) {
+        const uint64_t hash = HashWord(word);
+        for (size_t i = 0; i < MINHASH_SIZE; ++i) {
+            signature[i] = std::min(signature[i], functions.multipliers[i] * hash + functions.increments[i]);
         }
     }
-    for (int delete_id : delete_id_list) {
-        search_server.RemoveDocument(delete_id);
+    return signature;
+}
+
+// строк подписи в полосе LSH: чем больше, тем меньше лишних кандидатов, но пара
+// со сходством min_similarity должна оставаться кандидатом с MIN_CANDIDATE_PROBABILITY
+size_t ChooseRowsPerBand(double min_similarity) {
+    size_t rows_per_band = 1;
+    for (size_t rows = 2; rows <= MINHASH_SIZE; rows *= 2) {
+        const double band_count = static_cast<double>(MINHASH_SIZE / rows);
+        if (1.0 - std::pow(1.0 - std::pow(min_similarity, rows), band_count) >= MIN_CANDIDATE_PROBABILITY) {
+            rows_per_band = rows;
+        }
     }
+    return rows_per_band;
 }
 
+void RemoveFoundDuplicates(SearchServer& search_server, const std::vector<int>& duplicate_ids) {
+    for (const int document_id : duplicate_ids) {
+        std::cout << "Found duplicate document id " << document_id << std::endl;
+    }
+    search_server.RemoveDocuments(duplicate_ids);
+}
+}
+
+void RemoveDuplicates(SearchServer& search_server) {
+    const std::vector<int> document_ids(search_server.begin(), search_server.end());
+    std::vector<const WordFrequencies*> word_freqs(document_ids.size());
+    std::vector<uint64_t> fingerprints(document_ids.size());
+    search_server.GetThreadPool().ParallelFor(document_ids.size(), [&](size_t i) {
+        word_freqs[i] = &search_server.GetWordFrequencies(document_ids[i]);
+        fingerprints[i] = ComputeFingerprint(*word_freqs[i]);
+        }, MIN_DOCUMENTS_PER_THREAD);
+
+    // оставленные документы по отпечатку; при совпадении отпечатков наборы слов сверяются честно
+    std::unordered_map<uint64_t, std::vector<size_t>> kept_documents;
+    kept_documents.reserve(document_ids.size());
+    std::vector<int> duplicate_ids;
+    for (size_t i = 0; i < document_ids.size(); ++i) {
+        std::vector<size_t>& same_fingerprint = kept_documents[fingerprints[i]];
+        const bool is_duplicate = std::any_of(same_fingerprint.begin(), same_fingerprint.end(), [&](size_t kept) {
+            return HaveSameWords(*word_freqs[kept], *word_freqs[i]);
+            });
+        if (is_duplicate) {
+            duplicate_ids.push_back(document_ids[i]);
+        } else {
+            same_fingerprint.push_back(i);
+        }
+    }
+    RemoveFoundDuplicates(search_server, duplicate_ids);
+}
+
+void RemoveNearDuplicates(SearchServer& search_server, double min_similarity) {
+    if (!(min_similarity > 0.0 && min_similarity <= 1.0)) {
+        throw std::invalid_argument("Similarity threshold must be in (0, 1]");
+    }
+    const size_t rows_per_band = ChooseRowsPerBand(min_similarity);
+    const size_t band_count = MINHASH_SIZE / rows_per_band;
+
+    // от подписи хранятся только ключи полос: документ и кандидат совпали хотя бы в одной полосе
+    const std::vector<int> document_ids(search_server.begin(), search_server.end());
+    std::vector<const WordFrequencies*> word_freqs(document_ids.size());
+    std::vector<uint64_t> band_keys(document_ids.size() * band_count);
+    search_server.GetThreadPool().ParallelFor(document_ids.size(), [&](size_t i) {
+        word_freqs[i] = &search_server.GetWordFrequencies(document_ids[i]);
+        const auto signature = ComputeMinHash(*word_freqs[i]);
+        for (size_t band = 0; band < band_count; ++band) {
+            uint64_t key = MixHash(band);
+            for (size_t row = band * rows_per_band; row < (band + 1) * rows_per_band; ++row) {
+                key = MixHash(key ^ signature[row]);
+            }
+            band_keys[i * band_count + band] = key;
+        }
+        }, MIN_DOCUMENTS_PER_THREAD);
+
+    // оставленные документы с одинаковым ключом полосы связаны в список: голова в хеш-таблице,
+    // следующий - в next_kept[документ * band_count + полоса]
+    const size_t NO_DOCUMENT = SIZE_MAX;
+    std::unordered_map<uint64_t, size_t> band_to_last_kept;
+    band_to_last_kept.reserve(band_keys.size());
+    std::vector<size_t> next_kept(band_keys.size(), NO_DOCUMENT);
+    std::vector<size_t> candidates;
+    std::vector<int> duplicate_ids;
+    for (size_t i = 0; i < document_ids.size(); ++i) {
+        const uint64_t* keys = band_keys.data() + i * band_count;
+        candidates.clear();
+        for (size_t band = 0; band < band_count; ++band) {
+            const auto it = band_to_last_kept.find(keys[band]);
+            for (size_t kept = it != band_to_last_kept.end() ? it->second : NO_DOCUMENT; kept != NO_DOCUMENT;
+                kept = next_kept[kept * band_count + band]) {
+                candidates.push_back(kept);
+            }
+        }
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+        const bool is_duplicate = std::any_of(candidates.begin(), candidates.end(), [&](size_t kept) {
+            return ComputeJaccardSimilarity(*word_freqs[kept], *word_freqs[i]) >= min_similarity;
+            });
+        if (is_duplicate) {
+            duplicate_ids.push_back(document_ids[i]);
+            continue;
+        }
+        for (size_t band = 0; band < band_count; ++band) {
+            const auto [it, inserted] = band_to_last_kept.emplace(keys[band], i);
+            if (!inserted) {
+                next_kept[i * band_count + band] = it->second;
+                it->second = i;
+            }
+        }
+    }
+    RemoveFoundDuplicates(search_server, duplicate_ids);
+}
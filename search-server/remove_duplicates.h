@@ -1,4 +1,11 @@
 #pragma once
 #include "search_server.h"
 
+// Удаляет документы с тем же набором слов, что у документа с меньшим id
 void RemoveDuplicates(SearchServer& search_server);
+
+// Удаляет почти дубликаты: документы, у которых с одним из оставленных документов с меньшим id
+// коэффициент Жаккара множеств слов не меньше min_similarity (0 < min_similarity <= 1).
+// Пары-кандидаты ищутся по MinHash-подписям, поэтому пара со сходством у самого порога
+// изредка может быть пропущена; лишнего не удаляется - сходство кандидатов считается точно
+void RemoveNearDuplicates(SearchServer& search_server, double min_similarity);
@@ -0,0 +1,100 @@
+#include "result_cache.h"
+
+#include <stdexcept>
+#include <utility>
+
+bool ResultCache::Key::operator==(const Key& other) const {
+    return filter.status == other.filter.status && filter.min_rating == other.filter.min_rating
+        && filter.max_rating == other.filter.max_rating && top_count == other.top_count
+        && plus_terms == other.plus_terms && minus_terms == other.minus_terms && phrase_terms == other.phrase_terms;
+}
+
+size_t ResultCache::KeyHasher::operator()(const Key& key) const {
+    uint64_t hash = static_cast<uint64_t>(key.filter.status) * 31 + key.top_count;
+    auto add = [&hash](uint64_t value) {
+        hash = (hash ^ value) * 0x100000001b3ULL;
+    };
+    add(static_cast<uint32_t>(key.filter.min_rating));
+    add(static_cast<uint32_t>(key.filter.max_rating));
+    for (const TermId term_id : key.plus_terms) {
+        add(term_id);
+    }
+    // граница между плюс- и минус-словами, чтобы "a -b" и "a b" не совпадали по построению
+    add(INVALID_TERM_ID);
+    for (const TermId term_id : key.minus_terms) {
+        add(term_id);
+    }
+    add(INVALID_TERM_ID);
+    for (const TermId term_id : key.phrase_terms) {
+        add(term_id);
+    }
+    return static_cast<size_t>(hash ^ (hash >> 32));
+}
+
+ResultCache::ResultCache(size_t capacity, size_t shard_count)
+    : shard_capacity_(shard_count > 0 ? (capacity + shard_count - 1) / shard_count : 0)
+    , shards_(shard_count) {
+    if (capacity == 0 || shard_count == 0) {
+        throw std::invalid_argument("Result cache capacity and shard count must be positive");
+    }
+}
+
+ResultCache::Shard& ResultCache::GetShard(const Key& key) {
+    // младшие биты хеша выбирают корзину внутри шарда, шард берем по старшим
+    return shards_[(KeyHasher{}(key) >> 16) % shards_.size()];
+}
+
+bool ResultCache::Find(const Key& key, uint64_t index_version, std::vector<Document>& documents) {
+    Shard& shard = GetShard(key);
+    std::lock_guard guard(shard.mutex);
+    const auto it = shard.entries.find(key);
+    if (it == shard.entries.end() || it->second.index_version != index_version) {
+        ++shard.misses;
+        return false;
+    }
+    ++shard.hits;
+    shard.recent.splice(shard.recent.begin(), shard.recent, it->second.position);
+    documents = it->second.documents;
+    return true;
+}
+
+void ResultCache::Insert(Key key, uint64_t index_version, std::vector<Document> documents) {
+    Shard& shard = GetShard(key);
+    std::lock_guard guard(shard.mutex);
+    const auto [it, inserted] = shard.entries.try_emplace(std::move(key));
+    Entry& entry = it->second;
+    entry.index_version = index_version;
+    entry.documents = std::move(documents);
+    if (!inserted) {
+        shard.recent.splice(shard.recent.begin(), shard.recent, entry.position);
+        return;
+    }
+    // ключи unordered_map не переезжают при рехешировании, поэтому список хранит указатели на них
+    shard.recent.push_front(&it->first);
+    entry.position = shard.recent.begin();
+    if (shard.entries.size() > shard_capacity_) {
+        shard.entries.erase(*shard.recent.back());
+        shard.recent.pop_back();
+        ++shard.evictions;
+    }
+}
+
+ResultCache::Stats ResultCache::GetStats() const {
+    Stats stats;
+    for (const Shard& shard : shards_) {
+        std::lock_guard guard(shard.mutex);
+        stats.hits += shard.hits;
+        stats.misses += shard.misses;
+        stats.evictions += shard.evictions;
+        stats.size += shard.entries.size();
+    }
+    return stats;
+}
+
+void ResultCache::Clear() {
+    for (Shard& shard : shards_) {
+        std::lock_guard guard(shard.mutex);
+        shard.entries.clear();
+        shard.recent.clear();
+    }
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "document.h"
+#include "term_dictionary.h"
+
+// Кеш выдачи FindTopDocuments по статусу или DocumentFilter для SearchServer. Ключ - нормализованный запрос:
+// id плюс- и минус-слов после ParseQuery (по порядку слов, без повторов), фразы, фильтр и top_count.
+// Запись помнит версию индекса, на которой посчитана; после изменения индекса она считается промахом.
+// Версии уникальны среди всех SearchServer процесса, поэтому id слов разных серверов в ключе не путаются.
+// Ключи разложены по шардам, у каждого свой мьютекс и свой LRU-список, поэтому кеш можно звать из многих потоков
+class ResultCache {
+public:
+    struct Key {
+        std::vector<TermId> plus_terms;
+        std::vector<TermId> minus_terms;
+        std::vector<TermId> phrase_terms;  // фразы в кавычках подряд: число слов, затем id и место каждого слова
+        DocumentFilter filter;
+        size_t top_count = 0;
+
+        bool operator==(const Key& other) const;
+    };
+
+    struct Stats {
+        size_t hits = 0;
+        size_t misses = 0;     // в том числе записи, устаревшие после изменения индекса
+        size_t evictions = 0;  // вытеснено давно не использованных записей
+        size_t size = 0;
+    };
+
+    // capacity - сколько выдач хранить всего, делится поровну между shard_count шардами
+    explicit ResultCache(size_t capacity, size_t shard_count = 16);
+
+    ResultCache(const ResultCache&) = delete;
+    ResultCache& operator=(const ResultCache&) = delete;
+
+    // копирует выдачу в documents и возвращает true, если она есть и посчитана на index_version
+    bool Find(const Key& key, uint64_t index_version, std::vector<Document>& documents);
+    void Insert(Key key, uint64_t index_version, std::vector<Document> documents);
+    Stats GetStats() const;
+    void Clear();
+
+private:
+    struct KeyHasher {
+        size_t operator()(const Key& key) const;
+    };
+    struct Entry {
+        uint64_t index_version;
+        std::vector<Document> documents;
+        std::list<const Key*>::iterator position;  // место в Shard::recent
+    };
+    struct Shard {
+        mutable std::mutex mutex;
+        std::unordered_map<Key, Entry, KeyHasher> entries;
+        std::list<const Key*> recent;  // ключи entries от недавно использованных к давно
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t evictions = 0;
+    };
+
+    size_t shard_capacity_;
+    std::vector<Shard> shards_;
+
+    Shard& GetShard(const Key& key);
+};
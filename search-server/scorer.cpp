@@ -0,0 +1,21 @@
+#include "scorer.h"
+
+#include <stdexcept>
+
+Bm25Scorer::Bm25Scorer(double k1, double b)
+    : k1_(k1)
+    , b_(b) {
+    if (!(k1 >= 0) || !(b >= 0 && b <= 1)) {
+        throw std::invalid_argument("BM25 requires k1 >= 0 and b in [0, 1]");
+    }
+}
+
+Bm25Scorer Bm25Scorer::Prepare(const CorpusStats& corpus) const {
+    Bm25Scorer scorer = *this;
+    scorer.document_count_ = static_cast<double>(corpus.document_count);
+    scorer.length_norm_base_ = k1_ * (1.0 - b_);
+    // в пустом корпусе считать нечего, но деления на ноль быть не должно
+    scorer.length_norm_factor_ = corpus.average_document_length > 0 ? k1_ * b_ / corpus.average_document_length : 0.0;
+    scorer.document_lengths_ = corpus.document_lengths;
+    return scorer;
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+// Что формула релевантности знает о корпусе на момент запроса
+struct CorpusStats {
+    size_t document_count = 0;
+    double average_document_length = 0;
+    const uint32_t* document_lengths = nullptr;  // слов без стоп-слов, индекс - номер документа
+};
+
+// Формулы релевантности для SearchServer::FindTopDocuments. Scorer - шаблонный параметр поиска,
+// его методы встраиваются в цикл по вхождениям. Что нужно от Scorer:
+//   Prepare(corpus) - копия, готовая к одному запросу: все, что не зависит от документа, считается здесь;
+//   GetTermWeight(document_count, inverse_document_freq) - вес слова запроса, document_count - документов со словом;
+//   Score(ordinal, term_freq, term_weight) - вклад слова в релевантность документа с номером ordinal;
+//   GetMaxScore(max_term_freq, term_weight) - верхняя граница Score по всем документам слова, для отсечения
+
+// tf * IDF, как было всегда; релевантность совпадает с прежней до бита
+struct TfIdfScorer {
+    TfIdfScorer Prepare(const CorpusStats&) const {
+        return *this;
+    }
+    double GetTermWeight(size_t, double inverse_document_freq) const {
+        return inverse_document_freq;
+    }
+    double Score(uint32_t, double term_freq, double term_weight) const {
+        return term_freq * term_weight;
+    }
+    double GetMaxScore(double max_term_freq, double term_weight) const {
+        return max_term_freq * term_weight;
+    }
+};
+
+// Okapi BM25: вклад слова насыщается с ростом числа вхождений (k1), длинные документы штрафуются (b).
+// IDF - log(1 + (N - n + 0.5) / (n + 0.5)), всегда положительный
+class Bm25Scorer {
+public:
+    // k1 >= 0, b из [0, 1], иначе invalid_argument
+    explicit Bm25Scorer(double k1 = 1.2, double b = 0.75);
+
+    Bm25Scorer Prepare(const CorpusStats& corpus) const;
+
+    double GetTermWeight(size_t document_count, double) const {
+        const double n = static_cast<double>(document_count);
+        return std::log(1.0 + (document_count_ - n + 0.5) / (n + 0.5));
+    }
+    double Score(uint32_t ordinal, double term_freq, double term_weight) const {
+        // число вхождений восстанавливается из tf и длины документа: tf сложен из count слагаемых 1 / length
+        const double length = document_lengths_[ordinal];
+        const double count = std::round(term_freq * length);
+        return term_weight * count * (k1_ + 1.0) / (count + length_norm_base_ + length_norm_factor_ * length);
+    }
+    // count / (count + k1 * norm) < 1 при любом документе
+    double GetMaxScore(double, double term_weight) const {
+        return term_weight * (k1_ + 1.0);
+    }
+
+private:
+    double k1_;
+    double b_;
+    double document_count_ = 0;
+    // k1 * (1 - b + b * length / avgdl) = length_norm_base_ + length_norm_factor_ * length
+    double length_norm_base_ = 0;
+    double length_norm_factor_ = 0;
+    const uint32_t* document_lengths_ = nullptr;
+};
+
+// отличает Scorer от числа top_count в перегрузках SearchServer::FindTopDocuments
+template <typename Scorer, typename = void>
+struct IsScorer : std::false_type {};
+
+template <typename Scorer>
+struct IsScorer<Scorer, std::void_t<decltype(std::declval<const Scorer&>().Score(uint32_t{}, 0.0, 0.0))>>
+    : std::true_type {};
@@ -1,42 +1,300 @@
 #include "search_server.h"
 
+#include <atomic>
+#include <chrono>
+#include <fstream>
 
-SearchServer::SearchServer(const std::string& stop_words_text)
-    : SearchServer(SplitIntoWords(stop_words_text)) 
+#include "index_snapshot.h"
+
+
+SearchServer::SearchServer(const std::string& stop_words_text, size_t shard_count, PostingFormat posting_format,
+    WordPositions word_positions)
+    : SearchServer(SplitIntoWords(stop_words_text), shard_count, posting_format, word_positions)
 {
 }
 
-SearchServer::SearchServer(std::string_view stop_words_text)
-    : SearchServer(SplitIntoWords(stop_words_text))  
+SearchServer::SearchServer(std::string_view stop_words_text, size_t shard_count, PostingFormat posting_format,
+    WordPositions word_positions)
+    : SearchServer(SplitIntoWords(stop_words_text), shard_count, posting_format, word_positions)
                                                         
 {
 }
 
+SearchServer::SearchServer(const SearchServer& other)
+    : stop_words_(other.stop_words_)
+    , term_dictionary_(other.term_dictionary_)
+    , word_to_document_freqs_(other.word_to_document_freqs_)
+    , buffer_terms_(other.buffer_terms_)
+    , buffer_first_ordinal_(other.buffer_first_ordinal_)
+    , term_stats_(other.term_stats_)
+    , log_document_count_(other.log_document_count_)
+    , is_bulk_load_(other.is_bulk_load_)
+    , is_pruning_enabled_(other.is_pruning_enabled_)
+    , index_version_(other.index_version_)
+    , stale_terms_(other.stale_terms_)
+    , shard_count_(other.shard_count_)
+    , posting_format_(other.posting_format_)
+    , word_positions_(other.word_positions_)
+    , thread_pool_(other.thread_pool_)
+    , document_ordinals_(other.document_ordinals_)
+    , ordinal_to_document_id_(other.ordinal_to_document_id_)
+    , removed_ordinals_(other.removed_ordinals_)
+    , document_ratings_(other.document_ratings_)
+    , document_statuses_(other.document_statuses_)
+    , document_lengths_(other.document_lengths_)
+    , total_document_length_(other.total_document_length_)
+    , status_bitmaps_(other.status_bitmaps_)
+    , status_document_counts_(other.status_document_counts_)
+    , document_terms_(other.document_terms_)
+    , document_term_offsets_(other.document_term_offsets_)
+    , word_positions_data_(other.word_positions_data_)
+    , word_position_offsets_(other.word_position_offsets_)
+    , terms_with_removed_(other.terms_with_removed_)
+    , pending_removed_count_(other.pending_removed_count_)
+    , document_ids_(other.document_ids_)
+{
+    // PurgeRemovedDocuments меняет сегменты на месте, поэтому у копии они свои
+    segments_.reserve(other.segments_.size());
+    for (const auto& segment : other.segments_) {
+        segments_.push_back(std::make_shared<IndexSegment>(*segment));
+    }
+    // слова в частотах документов - string_view на арену словаря, переводим их на свой словарь
+    for (const auto& [document_id, word_freqs] : other.document_to_word_freqs_) {
+        auto& copy = document_to_word_freqs_.emplace_hint(document_to_word_freqs_.end(), document_id,
+            std::map<std::string_view, double>{})->second;
+        for (const auto& [word, term_freq] : word_freqs) {
+            copy.emplace_hint(copy.end(), term_dictionary_.GetTerm(term_dictionary_.Find(word)), term_freq);
+        }
+    }
+}
+
 void SearchServer::AddDocument(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings) {
-    if ((document_id < 0) || (documents_.count(document_id) > 0)) {
+    if ((document_id < 0) || (document_ordinals_.count(document_id) > 0)) {
         throw std::invalid_argument("Invalid document_id");
     }
-    const std::vector<std::string_view> words = SplitIntoWordsNoStop(document);
+    if (static_cast<size_t>(status) >= DOCUMENT_STATUS_COUNT) {
+        throw std::invalid_argument("Invalid document status");
+    }
+    FinishMerge(false);
+    static thread_local std::vector<std::string_view> words;
+    static thread_local std::vector<std::pair<TermId, uint32_t>> term_counts;
+    SplitIntoWordsNoStop(document, words);
+    std::sort(words.begin(), words.end());
 
-    const double inv_word_count = 1.0 / words.size();
+    const uint32_t document_length = static_cast<uint32_t>(words.size());
+    const uint32_t ordinal = static_cast<uint32_t>(ordinal_to_document_id_.size());
 
-    for (const std::string_view word : words) {
-        auto it = document_words_set_.emplace(std::string(word));
-        word_to_document_freqs_[*it.first][document_id] += inv_word_count;
-        document_to_word_freqs_[document_id][*it.first] += inv_word_count;
+    // одинаковые слова после сортировки идут подряд: в индекс кладем по записи на слово с числом вхождений
+    auto& word_freqs = document_to_word_freqs_[document_id];
+    term_counts.clear();
+    for (auto it = words.begin(); it != words.end();) {
+        const auto next = std::find_if(it, words.end(), [word = *it](std::string_view other) {
+            return other != word;
+            });
+        const uint32_t count = static_cast<uint32_t>(next - it);
+        const TermId term_id = term_dictionary_.Intern(*it);
+        word_freqs.emplace_hint(word_freqs.end(), term_dictionary_.GetTerm(term_id), ComputeTermFreq(count, document_length));
+        term_counts.emplace_back(term_id, count);
+        it = next;
+    }
+    word_to_document_freqs_.resize(term_dictionary_.size(), std::vector<PostingList>(shard_count_, PostingList(posting_format_)));
+    term_stats_.resize(term_dictionary_.size());
+    const size_t shard = GetShardIndex(document_id);
+    for (const auto& [term_id, count] : term_counts) {
+        word_to_document_freqs_[term_id][shard].Add(ordinal, count, document_length);
+        AddBufferTerm(term_id);
+        UpdateTermStats(term_id, 1);
+        term_stats_[term_id].max_term_freq = std::max(term_stats_[term_id].max_term_freq, ComputeTermFreq(count, document_length));
     }
 
-    documents_.emplace(document_id, DocumentData{ ComputeAverageRating(ratings), status });
-    document_ids_.insert(document_id);
+    const size_t first_term = document_terms_.size();
+    for (const auto& [term_id, count] : term_counts) {
+        document_terms_.push_back(term_id);
+    }
+    std::sort(document_terms_.begin() + first_term, document_terms_.end());
+    document_term_offsets_.push_back(document_terms_.size());
+    if (word_positions_ == WordPositions::STORED) {
+        AppendWordPositions(document);
+    }
+
+    AppendDocument(document_id, status, ComputeAverageRating(ratings), document_length);
+    UpdateDocumentCountStats();
+    index_version_ = NextIndexVersion();
+    FlushBufferIfNeeded();
+}
+
+void SearchServer::AddDocuments(const std::vector<DocumentToAdd>& documents) {
+    // Частичный индекс куска пакета: у куска свои номера слов, чтобы потоки не делили словарь
+    struct PartialIndex {
+        size_t first_document = 0;
+        size_t last_document = 0;
+        std::unordered_map<std::string_view, uint32_t> word_to_local_id;
+        std::vector<std::string_view> words;
+        std::vector<std::vector<std::pair<uint32_t, uint32_t>>> postings;  // индекс - локальный номер слова; номер документа и count
+        std::vector<TermId> term_ids;                // локальный номер -> id в term_dictionary_
+        size_t invalid_document = NO_INVALID_WORD;   // разбор куска останавливается на первом невалидном документе
+        std::string_view invalid_word;
+    };
+    // слова документа с tf, по возрастанию слова
+    std::vector<std::vector<std::pair<uint32_t, double>>> document_terms(documents.size());
+    std::vector<uint32_t> document_lengths(documents.size());
+
+    FinishMerge(false);
+    ThreadPool& thread_pool = GetThreadPool();
+    const size_t chunk_count = std::max<size_t>(1,
+        std::min(thread_pool.GetConcurrency() * 4, documents.size() / MIN_DOCUMENTS_PER_THREAD));
+    const uint32_t first_ordinal = static_cast<uint32_t>(ordinal_to_document_id_.size());
+    std::vector<PartialIndex> partial_indexes(chunk_count);
+    thread_pool.ParallelFor(chunk_count, [&](size_t chunk) {
+        PartialIndex& partial = partial_indexes[chunk];
+        partial.first_document = documents.size() * chunk / chunk_count;
+        partial.last_document = documents.size() * (chunk + 1) / chunk_count;
+        static thread_local std::vector<std::string_view> words;
+        for (size_t i = partial.first_document; i < partial.last_document; ++i) {
+            const size_t invalid_word = SplitDocumentIntoWords(documents[i].text, words);
+            if (invalid_word != NO_INVALID_WORD) {
+                partial.invalid_document = i;
+                partial.invalid_word = words[invalid_word];
+                return;
+            }
+            words.erase(std::remove_if(words.begin(), words.end(), [this](std::string_view word) {
+                return IsStopWord(word);
+                }), words.end());
+            std::sort(words.begin(), words.end());
+
+            document_lengths[i] = static_cast<uint32_t>(words.size());
+            for (auto it = words.begin(); it != words.end();) {
+                const std::string_view word = *it;
+                const auto next = std::find_if(it, words.end(), [word](std::string_view other) {
+                    return other != word;
+                    });
+                const uint32_t count = static_cast<uint32_t>(next - it);
+                it = next;
+                const auto [local_it, inserted] = partial.word_to_local_id.emplace(word, static_cast<uint32_t>(partial.words.size()));
+                if (inserted) {
+                    partial.words.push_back(word);
+                    partial.postings.emplace_back();
+                }
+                partial.postings[local_it->second].emplace_back(first_ordinal + static_cast<uint32_t>(i), count);
+                document_terms[i].emplace_back(local_it->second, ComputeTermFreq(count, document_lengths[i]));
+            }
+        }
+        });
+
+    // проверки в порядке документов: первым бросается то, что бросил бы цикл из AddDocument
+    std::unordered_set<int> batch_ids;
+    batch_ids.reserve(documents.size());
+    for (const PartialIndex& partial : partial_indexes) {
+        for (size_t i = partial.first_document; i < partial.last_document; ++i) {
+            const int document_id = documents[i].id;
+            if ((document_id < 0) || (document_ordinals_.count(document_id) > 0) || !batch_ids.insert(document_id).second) {
+                throw std::invalid_argument("Invalid document_id");
+            }
+            if (static_cast<size_t>(documents[i].status) >= DOCUMENT_STATUS_COUNT) {
+                throw std::invalid_argument("Invalid document status");
+            }
+            if (i == partial.invalid_document) {
+                throw std::invalid_argument("Word " + std::string(partial.invalid_word) + " is invalid");
+            }
+        }
+    }
+
+    // Дальше исключений нет. Слова заносим в словарь по разу на кусок
+    struct TermSource {
+        TermId term_id;
+        uint32_t chunk;
+        uint32_t local_id;
+    };
+    std::vector<TermSource> term_sources;
+    for (size_t chunk = 0; chunk < chunk_count; ++chunk) {
+        PartialIndex& partial = partial_indexes[chunk];
+        partial.term_ids.reserve(partial.words.size());
+        for (uint32_t local_id = 0; local_id < partial.words.size(); ++local_id) {
+            partial.term_ids.push_back(term_dictionary_.Intern(partial.words[local_id]));
+            term_sources.push_back({ partial.term_ids.back(), static_cast<uint32_t>(chunk), local_id });
+        }
+    }
+    word_to_document_freqs_.resize(term_dictionary_.size(), std::vector<PostingList>(shard_count_, PostingList(posting_format_)));
+    term_stats_.resize(term_dictionary_.size());
+    for (size_t i = 0; i < documents.size(); ++i) {
+        AppendDocument(documents[i].id, documents[i].status, ComputeAverageRating(documents[i].ratings), document_lengths[i]);
+    }
+    const size_t first_document_term = document_term_offsets_.size() - 1;
+    for (const auto& terms : document_terms) {
+        document_term_offsets_.push_back(document_term_offsets_.back() + terms.size());
+    }
+    document_terms_.resize(document_term_offsets_.back());
+
+    // Каждое слово сливается из кусков по порядку, номера документов в кусках растут - списки
+    // остаются отсортированными. Разные слова пишут в разные списки, поэтому сливаются параллельно
+    std::sort(term_sources.begin(), term_sources.end(), [](const TermSource& lhs, const TermSource& rhs) {
+        return std::pair(lhs.term_id, lhs.chunk) < std::pair(rhs.term_id, rhs.chunk);
+        });
+    std::vector<size_t> term_starts;
+    for (size_t i = 0; i < term_sources.size(); ++i) {
+        if (i == 0 || term_sources[i].term_id != term_sources[i - 1].term_id) {
+            term_starts.push_back(i);
+        }
+    }
+    term_starts.push_back(term_sources.size());
+    std::vector<int> added_document_counts(term_starts.size() - 1);
+    thread_pool.ParallelFor(added_document_counts.size(), [&](size_t term) {
+        for (size_t i = term_starts[term]; i < term_starts[term + 1]; ++i) {
+            const TermSource& source = term_sources[i];
+            auto& shard_postings = word_to_document_freqs_[source.term_id];
+            double& max_term_freq = term_stats_[source.term_id].max_term_freq;
+            for (const auto& [ordinal, count] : partial_indexes[source.chunk].postings[source.local_id]) {
+                const uint32_t document_length = document_lengths[ordinal - first_ordinal];
+                shard_postings[GetShardIndex(ordinal_to_document_id_[ordinal])].Add(ordinal, count, document_length);
+                max_term_freq = std::max(max_term_freq, ComputeTermFreq(count, document_length));
+            }
+            added_document_counts[term] += static_cast<int>(partial_indexes[source.chunk].postings[source.local_id].size());
+        }
+        for (PostingList& postings : word_to_document_freqs_[term_sources[term_starts[term]].term_id]) {
+            postings.Compact();
+        }
+        }, MIN_WORDS_PER_THREAD);
+    for (size_t term = 0; term < added_document_counts.size(); ++term) {
+        AddBufferTerm(term_sources[term_starts[term]].term_id);
+        UpdateTermStats(term_sources[term_starts[term]].term_id, added_document_counts[term]);
+    }
+
+    // словари частот документов собираются параллельно, в общий map переносятся готовыми
+    std::vector<std::map<std::string_view, double>> word_freqs(documents.size());
+    thread_pool.ParallelFor(documents.size(), [&](size_t i) {
+        const PartialIndex& partial = *std::prev(std::upper_bound(partial_indexes.begin(), partial_indexes.end(), i,
+            [](size_t document, const PartialIndex& index) {
+                return document < index.first_document;
+            }));
+        const auto terms = document_terms_.begin() + document_term_offsets_[first_document_term + i];
+        for (size_t j = 0; j < document_terms[i].size(); ++j) {
+            const auto& [local_id, term_freq] = document_terms[i][j];
+            word_freqs[i].emplace_hint(word_freqs[i].end(), term_dictionary_.GetTerm(partial.term_ids[local_id]), term_freq);
+            terms[j] = partial.term_ids[local_id];
+        }
+        std::sort(terms, terms + document_terms[i].size());
+        }, MIN_DOCUMENTS_PER_THREAD);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        document_to_word_freqs_.emplace(documents[i].id, std::move(word_freqs[i]));
+    }
+    if (word_positions_ == WordPositions::STORED) {
+        for (const DocumentToAdd& document : documents) {
+            AppendWordPositions(document.text);
+        }
+    }
+    UpdateDocumentCountStats();
+    index_version_ = NextIndexVersion();
+    FlushBufferIfNeeded();
 }
 
 std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentStatus status) const
 {
-    return FindTopDocuments(std::execution::seq,
-        raw_query, [status](int document_id, DocumentStatus document_status, int rating)
-        {
-            return document_status == status;
-        });
+    return FindTopDocuments(std::execution::seq, raw_query, status, MAX_RESULT_DOCUMENT_COUNT);
+}
+
+std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentStatus status, size_t top_count) const
+{
+    return FindTopDocuments(std::execution::seq, raw_query, status, top_count);
 }
 
 
@@ -45,59 +303,259 @@ std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query)
     return FindTopDocuments(std::execution::seq, raw_query, DocumentStatus::ACTUAL);
 }
 
-int SearchServer::GetDocumentCount() const {
-    return documents_.size();
+std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, const DocumentFilter& filter,
+    size_t top_count) const
+{
+    return FindTopDocuments(std::execution::seq, raw_query, filter, top_count);
 }
 
-std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(const std::string_view raw_query,
-    int document_id) const {
+std::vector<std::vector<Document>> SearchServer::FindTopDocumentsBatch(const std::vector<std::string>& raw_queries,
+    DocumentStatus status, size_t top_count) const {
+    std::vector<std::vector<Document>> results(raw_queries.size());
+    const DocumentFilter filter{ status };
+    const ColumnFilter document_filter = MakeColumnFilter(filter);
+    const TfIdfScorer scorer = TfIdfScorer{}.Prepare(GetCorpusStats());
+    const size_t group_count = (raw_queries.size() + BATCH_QUERY_GROUP_SIZE - 1) / BATCH_QUERY_GROUP_SIZE;
+    GetThreadPool().ParallelFor(group_count, [&](size_t group) {
+        const size_t first_query = group * BATCH_QUERY_GROUP_SIZE;
+        const size_t query_count = std::min(BATCH_QUERY_GROUP_SIZE, raw_queries.size() - first_query);
+        std::vector<Query> queries;
+        queries.reserve(query_count);
+        std::vector<TopDocuments> matched_documents(query_count, TopDocuments(top_count));
+        std::vector<ResultCache::Key> cache_keys(result_cache_ ? query_count : 0);
+        std::vector<bool> is_cached(query_count);
+        for (size_t i = 0; i < query_count; ++i) {
+            Query query = ParseQuery(raw_queries[first_query + i]);
+            // запрос, выдача которого нашлась в кеше, в группе остается пустым
+            if (result_cache_) {
+                cache_keys[i] = MakeResultCacheKey(query, filter, top_count);
+                if (result_cache_->Find(cache_keys[i], index_version_, results[first_query + i])) {
+                    is_cached[i] = true;
+                    queries.emplace_back();
+                    continue;
+                }
+            }
+            for (QueryTerm& term : query.plus_terms) {
+                term.inverse_document_freq = scorer.GetTermWeight(term_stats_[term.term_id].document_count,
+                    term.inverse_document_freq);
+            }
+            // общий обход группы фраз не проверяет: запрос с фразами считается отдельно, в группе остается пустым
+            if (!query.phrases.empty()) {
+                matched_documents[i] = FindQueryDocuments(std::execution::seq, query, document_filter, top_count, scorer);
+                query = Query{};
+            }
+            queries.push_back(std::move(query));
+        }
+        ScoreQueryGroup(queries, document_filter, scorer, matched_documents);
+        for (size_t i = 0; i < query_count; ++i) {
+            if (is_cached[i]) {
+                continue;
+            }
+            results[first_query + i] = matched_documents[i].Extract();
+            if (result_cache_) {
+                result_cache_->Insert(std::move(cache_keys[i]), index_version_, results[first_query + i]);
+            }
+        }
+        });
+    return results;
+}
 
-    const auto query = ParseQuery(std::execution::seq, raw_query);
-    std::vector<std::string_view> matched_words(query.plus_words.size());
-    if (document_ids_.count(document_id) == 0) { return { {}, {} }; }
-    const auto& words_freq = GetWordFrequencies(document_id);
-    auto word_checker = [&words_freq](const auto word) {
-        return words_freq.count(word);
-    };
+namespace {
+// Накопитель группы запросов на одно окно документов. Строка заводится на документ окна, когда его
+// впервые находит какой-нибудь запрос группы, поэтому память растет с числом найденных документов,
+// а не с размером окна на каждый запрос. В строке по ячейке на запрос, touched отмечает, в каких
+// запросах ячейка уже заполнена. Между окнами сбрасываются только массивы по смещениям в окне
+struct QueryGroupScratch {
+    static const uint32_t NO_ROW = UINT32_MAX;
+    static const uint32_t FILTERED_ROW = UINT32_MAX - 1;  // документ не прошел фильтр
+
+    std::vector<uint32_t> rows;       // смещение в окне -> строка, NO_ROW или FILTERED_ROW
+    std::vector<uint64_t> excluded;   // смещение в окне -> запросы, где документ исключен минус-словом
+    std::vector<uint32_t> row_offsets;
+    std::vector<uint64_t> touched;
+    std::vector<double> relevances;   // строка * BATCH_QUERY_GROUP_SIZE + запрос
+    uint32_t row_count = 0;
 
-    bool is_minus_word = any_of(std::execution::seq, query.minus_words.begin(), query.minus_words.end(), word_checker);
-    if (is_minus_word) {
-        return
-        { std::vector<std::string_view>{}, documents_.at(document_id).status };
+    void ResetWindow() {
+        rows.assign(BATCH_WINDOW_SIZE, NO_ROW);
+        excluded.assign(BATCH_WINDOW_SIZE, 0);
+        row_count = 0;
     }
-    copy_if(query.plus_words.begin(), query.plus_words.end(), matched_words.begin(), word_checker);
-    sort( matched_words.begin(), matched_words.end());
-    auto it_last = remove(matched_words.begin(), matched_words.end(), "");
-    matched_words.erase(it_last, matched_words.end());
-    return { matched_words, documents_.at(document_id).status };
+    uint32_t AddRow(uint32_t offset) {
+        if (row_count == row_offsets.size()) {
+            row_offsets.push_back(0);
+            touched.push_back(0);
+            relevances.resize(relevances.size() + BATCH_QUERY_GROUP_SIZE);
+        }
+        row_offsets[row_count] = offset;
+        touched[row_count] = 0;
+        return row_count++;
+    }
+};
 }
 
-std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(const std::execution::parallel_policy& policy,
-    const std::string_view raw_query, int document_id) const {
-   
-    const auto query = ParseQuery(std::execution::par, raw_query);
-    std::vector<std::string_view> matched_words(query.plus_words.size());
-    if (document_ids_.count(document_id) == 0) { return { {}, {} }; }
-    const auto& words_freq = GetWordFrequencies(document_id);
-    auto word_checker = [&words_freq](const auto word) {
-        return words_freq.count(word);
+void SearchServer::ScoreQueryGroup(const std::vector<Query>& queries, const ColumnFilter& document_filter,
+    const TfIdfScorer& scorer, std::vector<TopDocuments>& matched_documents) const {
+    static_assert(BATCH_QUERY_GROUP_SIZE <= 64, "запросы группы - биты uint64_t");
+    // слова группы по возрастанию: у каждого запроса они обходятся в том же порядке, что в FindTopDocuments,
+    // поэтому релевантность складывается в том же порядке и совпадает до бита
+    // Слово группы - его QueryTerm из любого запроса (списки и веса у всех одинаковые) и маска запросов, где оно есть
+    auto collect_terms = [this, &queries](std::vector<QueryTerm> Query::* terms) {
+        struct TermUse {
+            std::string_view word;
+            uint32_t query;
+            const QueryTerm* term;
+        };
+        std::vector<TermUse> uses;
+        for (uint32_t query = 0; query < queries.size(); ++query) {
+            for (const QueryTerm& term : queries[query].*terms) {
+                uses.push_back({ term_dictionary_.GetTerm(term.term_id), query, &term });
+            }
+        }
+        std::sort(uses.begin(), uses.end(), [](const TermUse& lhs, const TermUse& rhs) {
+            return std::pair(lhs.word, lhs.query) < std::pair(rhs.word, rhs.query);
+            });
+        std::vector<std::pair<const QueryTerm*, uint64_t>> group_terms;
+        for (size_t i = 0; i < uses.size(); ++i) {
+            if (i == 0 || uses[i].word != uses[i - 1].word) {
+                group_terms.emplace_back(uses[i].term, 0);
+            }
+            group_terms.back().second |= uint64_t{ 1 } << uses[i].query;
+        }
+        return group_terms;
     };
+    const auto minus_terms = collect_terms(&Query::minus_terms);
+    const auto plus_terms = collect_terms(&Query::plus_terms);
+
+    static thread_local QueryGroupScratch scratch;
+    std::vector<PostingList::Cursor> minus_cursors;
+    std::vector<PostingList::Cursor> plus_cursors;
+    for (size_t part = 0; part < GetPartCount(); ++part) {
+        const auto [first_ordinal, last_ordinal] = GetPartOrdinals(part);
+        minus_cursors.clear();
+        for (const auto& [term, term_queries] : minus_terms) {
+            minus_cursors.emplace_back(*term->part_postings[part], first_ordinal);
+        }
+        plus_cursors.clear();
+        for (const auto& [term, term_queries] : plus_terms) {
+            plus_cursors.emplace_back(*term->part_postings[part], first_ordinal);
+        }
+        for (uint32_t window_first = first_ordinal; window_first < last_ordinal;) {
+            const uint32_t window_last = static_cast<uint32_t>(
+                std::min<uint64_t>(last_ordinal, uint64_t{ window_first } + BATCH_WINDOW_SIZE));
+            scratch.ResetWindow();
+            // курсоры идут только вперед: каждое вхождение читается один раз на всю группу
+            for (size_t i = 0; i < minus_terms.size(); ++i) {
+                for (PostingList::Cursor& cursor = minus_cursors[i]; !cursor.IsEnd() && cursor.GetOrdinal() < window_last; cursor.Next()) {
+                    scratch.excluded[cursor.GetOrdinal() - window_first] |= minus_terms[i].second;
+                }
+            }
+            // слово за словом: вклад считается раз на вхождение и раздается запросам слова
+            for (size_t i = 0; i < plus_terms.size(); ++i) {
+                const double term_weight = plus_terms[i].first->inverse_document_freq;
+                const uint64_t term_queries = plus_terms[i].second;
+                for (PostingList::Cursor& cursor = plus_cursors[i]; !cursor.IsEnd() && cursor.GetOrdinal() < window_last; cursor.Next()) {
+                    const uint32_t ordinal = cursor.GetOrdinal();
+                    const uint32_t offset = ordinal - window_first;
+                    uint64_t queries_left = term_queries & ~scratch.excluded[offset];
+                    if (queries_left == 0) {
+                        continue;
+                    }
+                    uint32_t row = scratch.rows[offset];
+                    if (row == QueryGroupScratch::NO_ROW) {
+                        // фильтр спрашиваем раз на документ окна, а не на каждое вхождение
+                        row = document_filter(ordinal) ? scratch.AddRow(offset) : QueryGroupScratch::FILTERED_ROW;
+                        scratch.rows[offset] = row;
+                    }
+                    if (row == QueryGroupScratch::FILTERED_ROW) {
+                        continue;
+                    }
+                    const double relevance = scorer.Score(ordinal, cursor.GetTermFreq(), term_weight);
+                    double* const row_relevances = &scratch.relevances[size_t{ row } * BATCH_QUERY_GROUP_SIZE];
+                    const uint64_t row_touched = scratch.touched[row];
+                    scratch.touched[row] = row_touched | queries_left;
+                    // первый вклад пишется как есть: 0 + x == x, так что сумма та же, что у FindTopDocuments
+                    for (; queries_left != 0; queries_left &= queries_left - 1) {
+                        const uint32_t query = CountTrailingZeros(queries_left);
+                        row_relevances[query] = (row_touched >> query) & 1 ? row_relevances[query] + relevance : relevance;
+                    }
+                }
+            }
 
-    bool is_minus_word = any_of(std::execution::seq, query.minus_words.begin(), query.minus_words.end(), word_checker);
-    if (is_minus_word) {
-        return
-        { std::vector<std::string_view>{}, documents_.at(document_id).status };
+            for (uint32_t row = 0; row < scratch.row_count; ++row) {
+                const uint32_t ordinal = window_first + scratch.row_offsets[row];
+                const double* const row_relevances = &scratch.relevances[size_t{ row } * BATCH_QUERY_GROUP_SIZE];
+                for (uint64_t row_touched = scratch.touched[row]; row_touched != 0; row_touched &= row_touched - 1) {
+                    const uint32_t query = CountTrailingZeros(row_touched);
+                    const double relevance = row_relevances[query];
+                    TopDocuments& query_documents = matched_documents[query];
+                    // документ, заведомо худший уже отобранных, не проверяем; запас 2 * EPSILON - как в FindDocumentsPruned
+                    if (query_documents.IsFull() && relevance < query_documents.GetWorst().relevance - 2 * EPSILON) {
+                        continue;
+                    }
+                    query_documents.Push({ ordinal_to_document_id_[ordinal], relevance, document_ratings_[ordinal] });
+                }
+            }
+            window_first = window_last;
+        }
     }
-    copy_if(std::execution::par, query.plus_words.begin(), query.plus_words.end(), matched_words.begin(), word_checker);
-    sort(std::execution::par, matched_words.begin(), matched_words.end());
-    auto it_last = unique(std::execution::par, matched_words.begin(), matched_words.end());
-    matched_words.erase(it_last, matched_words.end());
-    it_last = remove(std::execution::par, matched_words.begin(), matched_words.end(), "");
-    matched_words.erase(it_last, matched_words.end());
+}
+
+void SearchServer::SetThreadPool(std::shared_ptr<ThreadPool> thread_pool) {
+    thread_pool_ = std::move(thread_pool);
+}
 
-    return { matched_words, documents_.at(document_id).status };
+ThreadPool& SearchServer::GetThreadPool() const {
+    return *thread_pool_;
+}
+
+uint64_t SearchServer::NextIndexVersion() {
+    static std::atomic<uint64_t> last_version{ 0 };
+    return last_version.fetch_add(1, std::memory_order_relaxed) + 1;
+}
 
-  
+void SearchServer::SetResultCache(std::shared_ptr<ResultCache> result_cache) {
+    result_cache_ = std::move(result_cache);
+}
+
+int SearchServer::GetDocumentCount() const {
+    return document_ordinals_.size();
+}
+
+void SearchServer::SetPruning(bool is_enabled) {
+    is_pruning_enabled_ = is_enabled;
+}
+
+void SearchServer::BeginBulkLoad() {
+    is_bulk_load_ = true;
+}
+
+void SearchServer::CommitBulkLoad() {
+    is_bulk_load_ = false;
+    for (const TermId term_id : stale_terms_) {
+        term_stats_[term_id].is_stale = false;
+        UpdateTermStats(term_id, 0);
+        for (PostingList& postings : word_to_document_freqs_[term_id]) {
+            postings.Compact();
+        }
+    }
+    stale_terms_.clear();
+    UpdateDocumentCountStats();
+    index_version_ = NextIndexVersion();
+}
+
+std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(const std::string_view raw_query,
+    int document_id) const {
+
+    const MatchQuery query = ParseMatchQuery(raw_query);
+    if (document_ids_.count(document_id) == 0) { return { {}, {} }; }
+    return MatchParsedQuery(query, document_id);
+}
+
+// слова документа и запроса пересекаются за один проход, делить его между потоками невыгодно
+std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(const std::execution::parallel_policy& policy,
+    const std::string_view raw_query, int document_id) const {
+    return MatchDocument(raw_query, document_id);
 }
 
 std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument
@@ -106,6 +564,126 @@ std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDoc
     return MatchDocument(raw_query, document_id);
 }
 
+std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> SearchServer::MatchDocuments(
+    const std::string_view raw_query, const std::vector<int>& document_ids) const {
+    const MatchQuery query = ParseMatchQuery(raw_query);
+    std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> results(document_ids.size());
+    GetThreadPool().ParallelFor(document_ids.size(), [&](size_t i) {
+        if (document_ids_.count(document_ids[i]) > 0) {
+            results[i] = MatchParsedQuery(query, document_ids[i]);
+        }
+        }, MIN_DOCUMENTS_PER_THREAD);
+    return results;
+}
+
+SearchServer::MatchQuery SearchServer::ParseMatchQuery(std::string_view text) const {
+    Query query = ParseQuery(text, false);
+    MatchQuery match_query;
+    match_query.phrases = std::move(query.phrases);
+    for (const QueryTerm& term : query.minus_terms) {
+        match_query.minus_term_ids.push_back(term.term_id);
+    }
+    std::sort(match_query.minus_term_ids.begin(), match_query.minus_term_ids.end());
+
+    std::vector<std::pair<TermId, uint32_t>> plus_terms;
+    for (const QueryTerm& term : query.plus_terms) {
+        plus_terms.emplace_back(term.term_id, static_cast<uint32_t>(match_query.plus_words.size()));
+        match_query.plus_words.push_back(term_dictionary_.GetTerm(term.term_id));
+    }
+    std::sort(plus_terms.begin(), plus_terms.end());
+    for (const auto& [term_id, word_index] : plus_terms) {
+        match_query.plus_term_ids.push_back(term_id);
+        match_query.plus_word_indices.push_back(word_index);
+    }
+    return match_query;
+}
+
+namespace {
+// Вызывает on_match(i) для каждого query[i], который есть в document; оба массива по возрастанию.
+// Если один массив намного короче, каждый его элемент ищется в длинном галопом от прошлой находки:
+// шаг удваивается, пока не перескочит искомое, потом двоичный поиск внутри последнего шага
+template <typename Function>
+void IntersectTermIds(const std::vector<TermId>& query, const TermId* document_first, const TermId* document_last,
+    Function on_match) {
+    const size_t document_size = document_last - document_first;
+    if (query.size() * 8 < document_size) {
+        const TermId* position = document_first;
+        for (size_t i = 0; i < query.size() && position != document_last; ++i) {
+            size_t step = 1;
+            while (position + step < document_last && position[step] < query[i]) {
+                step *= 2;
+            }
+            position = std::lower_bound(position, std::min(position + step + 1, document_last), query[i]);
+            if (position != document_last && *position == query[i]) {
+                on_match(i);
+            }
+        }
+        return;
+    }
+    if (document_size * 8 < query.size()) {
+        size_t position = 0;
+        for (const TermId* term = document_first; term != document_last && position < query.size(); ++term) {
+            size_t step = 1;
+            while (position + step < query.size() && query[position + step] < *term) {
+                step *= 2;
+            }
+            position = std::lower_bound(query.begin() + position, query.begin() + std::min(position + step + 1, query.size()), *term)
+                - query.begin();
+            if (position != query.size() && query[position] == *term) {
+                on_match(position);
+            }
+        }
+        return;
+    }
+    for (size_t i = 0; i < query.size() && document_first != document_last;) {
+        if (query[i] < *document_first) {
+            ++i;
+        } else if (*document_first < query[i]) {
+            ++document_first;
+        } else {
+            on_match(i++);
+            ++document_first;
+        }
+    }
+}
+}
+
+std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchParsedQuery(const MatchQuery& query,
+    int document_id) const {
+    const uint32_t ordinal = document_ordinals_.at(document_id);
+    const DocumentStatus status = document_statuses_[ordinal];
+    const TermId* document_first = document_terms_.data() + document_term_offsets_[ordinal];
+    const TermId* document_last = document_terms_.data() + document_term_offsets_[ordinal + 1];
+
+    bool is_minus_word = false;
+    IntersectTermIds(query.minus_term_ids, document_first, document_last, [&is_minus_word](size_t) {
+        is_minus_word = true;
+        });
+    const bool has_phrases = std::all_of(query.phrases.begin(), query.phrases.end(),
+        [this, ordinal](const std::vector<PhraseTerm>& phrase) {
+            return ContainsPhrase(ordinal, phrase);
+        });
+    if (is_minus_word || !has_phrases) {
+        return { std::vector<std::string_view>{}, status };
+    }
+    // совпадения приходят по возрастанию id, а выдача нужна по алфавиту - отмечаем и собираем по порядку слов
+    static thread_local std::vector<char> is_matched;
+    is_matched.assign(query.plus_words.size(), 0);
+    size_t matched_count = 0;
+    IntersectTermIds(query.plus_term_ids, document_first, document_last, [&](size_t i) {
+        is_matched[query.plus_word_indices[i]] = 1;
+        ++matched_count;
+        });
+    std::vector<std::string_view> matched_words;
+    matched_words.reserve(matched_count);
+    for (size_t i = 0; i < query.plus_words.size(); ++i) {
+        if (is_matched[i]) {
+            matched_words.push_back(query.plus_words[i]);
+        }
+    }
+    return { matched_words, status };
+}
+
 bool SearchServer::IsStopWord(const std::string_view word) const {
     return stop_words_.count(word) > 0;
 }
@@ -116,17 +694,25 @@ bool SearchServer::IsValidWord(const std::string_view word) {
         });
 }
 
-std::vector<std::string_view> SearchServer::SplitIntoWordsNoStop(const std::string_view text) const {
-    std::vector<std::string_view> words;
-    for (const std::string_view word : SplitIntoWords(text)) {
-        if (!IsValidWord(word)) {
-            throw std::invalid_argument("Word " + std::string(word) + " is invalid");
-        }
-        if (!IsStopWord(word)) {
-            words.push_back(word);
-        }
+size_t SearchServer::SplitDocumentIntoWords(const std::string_view text, std::vector<std::string_view>& words) const {
+    const size_t invalid_word = SplitIntoWords(text, words);
+    if (word_positions_ != WordPositions::STORED || text.find('"') == std::string_view::npos) {
+        return invalid_word;
     }
-    return words;
+    const auto quoted = std::find_if(words.begin(), words.end(), [](std::string_view word) {
+        return word.find('"') != std::string_view::npos;
+        });
+    return std::min(invalid_word, static_cast<size_t>(quoted - words.begin()));
+}
+
+void SearchServer::SplitIntoWordsNoStop(const std::string_view text, std::vector<std::string_view>& words) const {
+    const size_t invalid_word = SplitDocumentIntoWords(text, words);
+    if (invalid_word != NO_INVALID_WORD) {
+        throw std::invalid_argument("Word " + std::string(words[invalid_word]) + " is invalid");
+    }
+    words.erase(std::remove_if(words.begin(), words.end(), [this](std::string_view word) {
+        return IsStopWord(word);
+        }), words.end());
 }
 
 int SearchServer::ComputeAverageRating(const std::vector<int>& ratings) {
@@ -135,7 +721,7 @@ int SearchServer::ComputeAverageRating(const std::vector<int>& ratings) {
     return rating_sum / static_cast<int>(ratings.size());
 }
 
-SearchServer::QueryWord SearchServer::ParseQueryWord(const std::string_view text) const {
+SearchServer::QueryWord SearchServer::ParseQueryWord(const std::string_view text, bool may_be_invalid) const {
     if (text.empty()) {
         throw std::invalid_argument("Query word is empty");
     }
@@ -145,19 +731,609 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(const std::string_view text
         is_minus = true;
         word = word.substr(1);
     }
-    if (word.empty() || word[0] == '-' || !IsValidWord(word)) {
+    if (word.empty() || word[0] == '-' || (may_be_invalid && !IsValidWord(word))) {
         throw std::invalid_argument("Query word " + std::string(text) + " is invalid");
     }
     return { word, is_minus, IsStopWord(word) };
 }
 
 
-double SearchServer::ComputeWordInverseDocumentFreq(const std::string_view word) const {
-    if (word_to_document_freqs_.at(word).size() == 0) {
-        throw std::invalid_argument("The word is missing from the document");
+double SearchServer::ComputeWordInverseDocumentFreq(TermId term_id) const {
+    return log_document_count_ - term_stats_[term_id].log_document_count;
+}
+
+void SearchServer::UpdateTermStats(TermId term_id, int document_count_delta) {
+    TermStats& stats = term_stats_[term_id];
+    stats.document_count += document_count_delta;
+    if (is_bulk_load_) {
+        if (!stats.is_stale) {
+            stats.is_stale = true;
+            stale_terms_.push_back(term_id);
+        }
+        return;
+    }
+    stats.log_document_count = stats.document_count > 0 ? std::log(stats.document_count) : 0.0;
+}
+
+void SearchServer::UpdateDocumentCountStats() {
+    if (!is_bulk_load_) {
+        log_document_count_ = document_ordinals_.empty() ? 0.0 : std::log(document_ordinals_.size());
     }
-    return std::log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
-  
+}
+
+size_t SearchServer::GetShardIndex(int document_id) const {
+    return static_cast<size_t>(document_id) % shard_count_;
+}
+
+ResultCache::Key SearchServer::MakeResultCacheKey(const Query& query, const DocumentFilter& filter, size_t top_count) {
+    // слова запроса ParseQuery уже отсортировал и избавил от повторов и стоп-слов
+    ResultCache::Key key;
+    key.plus_terms.reserve(query.plus_terms.size());
+    for (const QueryTerm& term : query.plus_terms) {
+        key.plus_terms.push_back(term.term_id);
+    }
+    key.minus_terms.reserve(query.minus_terms.size());
+    for (const QueryTerm& term : query.minus_terms) {
+        key.minus_terms.push_back(term.term_id);
+    }
+    // фраза - число слов и пары (id слова, место в фразе)
+    for (const auto& phrase : query.phrases) {
+        key.phrase_terms.push_back(static_cast<TermId>(phrase.size()));
+        for (const PhraseTerm& term : phrase) {
+            key.phrase_terms.push_back(term.term_id);
+            key.phrase_terms.push_back(term.offset);
+        }
+    }
+    key.filter = filter;
+    key.top_count = top_count;
+    return key;
+}
+
+CorpusStats SearchServer::GetCorpusStats() const {
+    CorpusStats corpus;
+    corpus.document_count = document_ordinals_.size();
+    corpus.average_document_length = corpus.document_count > 0
+        ? static_cast<double>(total_document_length_) / corpus.document_count : 0.0;
+    corpus.document_lengths = document_lengths_.data();
+    return corpus;
+}
+
+SearchServer::ColumnFilter SearchServer::MakeColumnFilter(const DocumentFilter& filter) const {
+    if (static_cast<size_t>(filter.status) >= DOCUMENT_STATUS_COUNT) {
+        throw std::invalid_argument("Invalid document status");
+    }
+    const bool has_rating_range = filter.min_rating != INT_MIN || filter.max_rating != INT_MAX;
+    // долю документов, прошедших по рейтингу, не знаем; с диапазоном рейтинга фильтр считаем избирательным
+    const bool is_selective = has_rating_range || status_document_counts_[static_cast<size_t>(filter.status)] * 100
+        < ordinal_to_document_id_.size() * SELECTIVE_FILTER_PERCENT;
+    return { status_bitmaps_[static_cast<size_t>(filter.status)].data(), document_ratings_.data(),
+        filter.min_rating, filter.max_rating, has_rating_range, is_selective };
+}
+
+void SearchServer::AppendDocument(int document_id, DocumentStatus status, int rating, uint32_t document_length) {
+    const uint32_t ordinal = static_cast<uint32_t>(ordinal_to_document_id_.size());
+    document_ordinals_.emplace(document_id, ordinal);
+    ordinal_to_document_id_.push_back(document_id);
+    removed_ordinals_.push_back(false);
+    document_ids_.insert(document_id);
+    document_ratings_.push_back(rating);
+    document_statuses_.push_back(status);
+    document_lengths_.push_back(document_length);
+    total_document_length_ += document_length;
+    for (std::vector<uint64_t>& bitmap : status_bitmaps_) {
+        bitmap.resize(ordinal / 64 + 1);
+    }
+    status_bitmaps_[static_cast<size_t>(status)][ordinal >> 6] |= uint64_t{ 1 } << (ordinal & 63);
+    ++status_document_counts_[static_cast<size_t>(status)];
+}
+
+namespace {
+// число по 7 бит в байте, от младших к старшим; старший бит байта - будет продолжение
+void AppendVarint(uint32_t value, std::vector<uint8_t>& data) {
+    for (; value >= 0x80; value >>= 7) {
+        data.push_back(static_cast<uint8_t>(value | 0x80));
+    }
+    data.push_back(static_cast<uint8_t>(value));
+}
+
+uint32_t ReadVarint(const uint8_t*& data) {
+    uint32_t value = 0;
+    for (int shift = 0;; shift += 7) {
+        const uint8_t byte = *data++;
+        value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+    }
+}
+}
+
+void SearchServer::AppendWordPositions(std::string_view document) {
+    static thread_local std::vector<std::string_view> words;
+    static thread_local std::vector<std::pair<TermId, uint32_t>> term_positions;
+    // документ уже проверен при разборе, а его слова занесены в словарь
+    SplitIntoWords(document, words);
+    term_positions.clear();
+    for (uint32_t position = 0; position < words.size(); ++position) {
+        if (!IsStopWord(words[position])) {
+            term_positions.emplace_back(term_dictionary_.Find(words[position]), position);
+        }
+    }
+    // после сортировки слова идут в порядке document_terms_ документа, позиции слова - по возрастанию
+    std::sort(term_positions.begin(), term_positions.end());
+    static thread_local std::vector<uint8_t> term_data;
+    for (size_t i = 0; i < term_positions.size(); ++i) {
+        const bool is_term_first = i == 0 || term_positions[i - 1].first != term_positions[i].first;
+        if (is_term_first) {
+            term_data.clear();
+        }
+        AppendVarint(term_positions[i].second - (is_term_first ? 0 : term_positions[i - 1].second), term_data);
+        if (i + 1 == term_positions.size() || term_positions[i + 1].first != term_positions[i].first) {
+            AppendVarint(static_cast<uint32_t>(term_data.size()), word_positions_data_);
+            word_positions_data_.insert(word_positions_data_.end(), term_data.begin(), term_data.end());
+        }
+    }
+    word_position_offsets_.push_back(word_positions_data_.size());
+}
+
+void SearchServer::DecodeWordPositions(uint32_t ordinal, size_t term_index, std::vector<uint32_t>& positions) const {
+    const uint8_t* data = word_positions_data_.data() + word_position_offsets_[ordinal];
+    // списки предыдущих слов документа перескакиваются по длине
+    for (size_t i = 0; i < term_index; ++i) {
+        const uint32_t size = ReadVarint(data);
+        data += size;
+    }
+    const uint32_t size = ReadVarint(data);
+    const uint8_t* const data_end = data + size;
+    positions.clear();
+    uint32_t position = 0;
+    while (data != data_end) {
+        position += ReadVarint(data);
+        positions.push_back(position);
+    }
+}
+
+bool SearchServer::ContainsPhrase(uint32_t ordinal, const std::vector<PhraseTerm>& phrase) const {
+    static thread_local std::vector<uint32_t> starts;
+    static thread_local std::vector<uint32_t> positions;
+    const TermId* document_first = document_terms_.data() + document_term_offsets_[ordinal];
+    const TermId* document_last = document_terms_.data() + document_term_offsets_[ordinal + 1];
+    // starts - где фраза еще может начинаться; каждое следующее слово оставляет те начала, где оно стоит на своем месте
+    for (size_t i = 0; i < phrase.size(); ++i) {
+        const TermId* term = std::lower_bound(document_first, document_last, phrase[i].term_id);
+        if (term == document_last || *term != phrase[i].term_id) {
+            return false;
+        }
+        DecodeWordPositions(ordinal, term - document_first, positions);
+        if (i == 0) {
+            // у первого слова фразы место 0
+            starts = positions;
+        } else {
+            // начала и позиции растут, поэтому поиск каждого следующего начинается с прошлой находки
+            auto position = positions.begin();
+            size_t kept_start_count = 0;
+            for (const uint32_t start : starts) {
+                position = std::lower_bound(position, positions.end(), start + phrase[i].offset);
+                if (position != positions.end() && *position == start + phrase[i].offset) {
+                    starts[kept_start_count++] = start;
+                }
+            }
+            starts.resize(kept_start_count);
+        }
+        if (starts.empty()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<uint64_t> SearchServer::FindPhraseDocuments(const Query& query) const {
+    std::vector<uint64_t> phrase_bits(ordinal_to_document_id_.size() / 64 + 1, 0);
+    // все слова всех фраз, от редких к частым: самый короткий список задает кандидатов
+    std::vector<TermId> term_ids;
+    for (const auto& phrase : query.phrases) {
+        for (const PhraseTerm& term : phrase) {
+            if (term.term_id == INVALID_TERM_ID) {
+                return phrase_bits;
+            }
+            term_ids.push_back(term.term_id);
+        }
+    }
+    std::sort(term_ids.begin(), term_ids.end());
+    term_ids.erase(std::unique(term_ids.begin(), term_ids.end()), term_ids.end());
+    std::sort(term_ids.begin(), term_ids.end(), [this](TermId lhs, TermId rhs) {
+        return term_stats_[lhs].document_count < term_stats_[rhs].document_count;
+        });
+    std::vector<std::vector<const PostingList*>> term_postings;
+    for (const TermId term_id : term_ids) {
+        term_postings.push_back(GetTermPostings(term_id));
+    }
+
+    std::vector<PostingList::Cursor> cursors;
+    for (size_t part = 0; part < GetPartCount(); ++part) {
+        const uint32_t first_ordinal = GetPartOrdinals(part).first;
+        cursors.clear();
+        for (const auto& postings : term_postings) {
+            cursors.emplace_back(*postings[part], first_ordinal);
+        }
+        // кандидат - документ первого списка; остальные курсоры догоняют его перескоком,
+        // а если перескакивают дальше, кандидатом становится их документ
+        bool is_exhausted = false;
+        while (!is_exhausted && !cursors[0].IsEnd()) {
+            const uint32_t ordinal = cursors[0].GetOrdinal();
+            uint32_t next_ordinal = ordinal;
+            for (size_t i = 1; i < cursors.size() && next_ordinal == ordinal; ++i) {
+                cursors[i].Seek(ordinal);
+                if (cursors[i].IsEnd()) {
+                    is_exhausted = true;
+                    break;
+                }
+                next_ordinal = cursors[i].GetOrdinal();
+            }
+            if (is_exhausted) {
+                break;
+            }
+            if (next_ordinal != ordinal) {
+                cursors[0].Seek(next_ordinal);
+                continue;
+            }
+            // удаленные документы в выдачу все равно не попадут, их позиции не читаем
+            const bool has_phrases = !removed_ordinals_[ordinal]
+                && std::all_of(query.phrases.begin(), query.phrases.end(), [this, ordinal](const std::vector<PhraseTerm>& phrase) {
+                    return ContainsPhrase(ordinal, phrase);
+                    });
+            if (has_phrases) {
+                phrase_bits[ordinal >> 6] |= uint64_t{ 1 } << (ordinal & 63);
+            }
+            cursors[0].Next();
+        }
+    }
+    return phrase_bits;
+}
+
+SearchServer::Query SearchServer::ParseQuery(std::string_view text, bool with_postings) const {
+    std::vector<std::string_view> plus_words;
+    std::vector<std::string_view> minus_words;
+    std::vector<std::vector<PhraseTerm>> phrases;
+    static thread_local std::vector<std::string_view> words;
+    // управляющие символы SplitIntoWords ищет сам, перепроверяем только слова начиная с первого невалидного
+    const size_t first_invalid_word = SplitIntoWords(text, words);
+    // Фраза открывается словом с " в начале и закрывается словом с " в конце. Без позиций слов кавычка -
+    // обычный символ, как раньше
+    const bool has_phrases = word_positions_ == WordPositions::STORED;
+    bool is_in_phrase = false;
+    uint32_t phrase_offset = 0;
+    // проверяем все слова, в том числе отсутствующие в индексе: невалидный запрос - исключение
+    for (size_t i = 0; i < words.size(); ++i) {
+        std::string_view word = words[i];
+        bool is_phrase_end = false;
+        if (has_phrases) {
+            if (!is_in_phrase && word[0] == '"') {
+                is_in_phrase = true;
+                phrase_offset = 0;
+                phrases.emplace_back();
+                word.remove_prefix(1);
+            }
+            if (is_in_phrase && !word.empty() && word.back() == '"') {
+                is_phrase_end = true;
+                word.remove_suffix(1);
+            }
+            if (word.empty()) {
+                is_in_phrase = !is_phrase_end;
+                continue;
+            }
+        }
+        const auto query_word = ParseQueryWord(word, i >= first_invalid_word);
+        if (has_phrases && (query_word.data.find('"') != std::string_view::npos || (is_in_phrase && query_word.is_minus))) {
+            throw std::invalid_argument("Query word " + std::string(words[i]) + " is invalid");
+        }
+        if (is_in_phrase) {
+            if (!query_word.is_stop) {
+                const TermId term_id = term_dictionary_.Find(query_word.data);
+                const bool is_indexed = term_id != INVALID_TERM_ID && term_stats_[term_id].document_count > 0;
+                phrases.back().push_back({ is_indexed ? term_id : INVALID_TERM_ID, phrase_offset });
+            }
+            ++phrase_offset;
+            is_in_phrase = !is_phrase_end;
+        }
+        if (!query_word.is_stop) {
+            if (query_word.is_minus) {
+                minus_words.push_back(query_word.data);
+            } else {
+                plus_words.push_back(query_word.data);
+            }
+        }
+    }
+    if (is_in_phrase) {
+        throw std::invalid_argument("Query phrase is not closed");
+    }
+    // Стоп-слово внутри фразы - место для одного любого слова, по краям фразы стоп-слова ничего не требуют:
+    // места отсчитываются от первого значимого слова. Фраза из одних стоп-слов ничего не требует
+    phrases.erase(std::remove_if(phrases.begin(), phrases.end(), [](const std::vector<PhraseTerm>& phrase) {
+        return phrase.empty();
+        }), phrases.end());
+    for (auto& phrase : phrases) {
+        const uint32_t first_offset = phrase.front().offset;
+        for (PhraseTerm& term : phrase) {
+            term.offset -= first_offset;
+        }
+    }
+    return { ResolveQueryTerms(plus_words, with_postings), ResolveQueryTerms(minus_words, with_postings), std::move(phrases) };
+}
+
+std::vector<SearchServer::QueryTerm> SearchServer::ResolveQueryTerms(std::vector<std::string_view>& words,
+    bool with_postings) const {
+    sort(words.begin(), words.end());
+    words.erase(unique(words.begin(), words.end()), words.end());
+
+    std::vector<QueryTerm> terms;
+    terms.reserve(words.size());
+    for (const std::string_view word : words) {
+        const TermId term_id = term_dictionary_.Find(word);
+        if (term_id == INVALID_TERM_ID) {
+            continue;
+        }
+        if (term_stats_[term_id].document_count == 0) {
+            continue;
+        }
+        terms.push_back({ term_id, with_postings ? GetTermPostings(term_id) : std::vector<const PostingList*>{},
+            ComputeWordInverseDocumentFreq(term_id) });
+    }
+    return terms;
+}
+
+size_t SearchServer::GetPartCount() const {
+    return (segments_.size() + 1) * shard_count_;
+}
+
+std::pair<uint32_t, uint32_t> SearchServer::GetPartOrdinals(size_t part) const {
+    const size_t segment = part / shard_count_;
+    if (segment == segments_.size()) {
+        return { buffer_first_ordinal_, static_cast<uint32_t>(ordinal_to_document_id_.size()) };
+    }
+    return { segments_[segment]->first_ordinal, segments_[segment]->last_ordinal };
+}
+
+std::vector<const PostingList*> SearchServer::GetTermPostings(TermId term_id) const {
+    static const PostingList empty_postings;
+    std::vector<const PostingList*> part_postings;
+    part_postings.reserve(GetPartCount());
+    for (const auto& segment : segments_) {
+        const std::vector<PostingList>* shard_postings = segment->Find(term_id);
+        for (size_t shard = 0; shard < shard_count_; ++shard) {
+            part_postings.push_back(shard_postings != nullptr ? &(*shard_postings)[shard] : &empty_postings);
+        }
+    }
+    for (const PostingList& postings : word_to_document_freqs_[term_id]) {
+        part_postings.push_back(&postings);
+    }
+    return part_postings;
+}
+
+void SearchServer::AddBufferTerm(TermId term_id) {
+    if (!term_stats_[term_id].is_in_buffer) {
+        term_stats_[term_id].is_in_buffer = true;
+        buffer_terms_.push_back(term_id);
+    }
+}
+
+void SearchServer::FlushBuffer() {
+    const uint32_t last_ordinal = static_cast<uint32_t>(ordinal_to_document_id_.size());
+    if (last_ordinal == buffer_first_ordinal_) {
+        return;
+    }
+    FinishMerge(false);
+    auto segment = std::make_shared<IndexSegment>();
+    segment->first_ordinal = buffer_first_ordinal_;
+    segment->last_ordinal = last_ordinal;
+    std::sort(buffer_terms_.begin(), buffer_terms_.end());
+    segment->term_ids.reserve(buffer_terms_.size());
+    segment->postings.reserve(buffer_terms_.size());
+    for (const TermId term_id : buffer_terms_) {
+        term_stats_[term_id].is_in_buffer = false;
+        auto& shard_postings = word_to_document_freqs_[term_id];
+        // списки, вычищенные PurgeRemovedDocuments до пустых, в сегмент не берем
+        if (std::all_of(shard_postings.begin(), shard_postings.end(), [](const PostingList& postings) {
+            return postings.empty();
+            })) {
+            continue;
+        }
+        for (PostingList& postings : shard_postings) {
+            postings.Compact();
+        }
+        segment->term_ids.push_back(term_id);
+        segment->postings.push_back(std::exchange(shard_postings,
+            std::vector<PostingList>(shard_count_, PostingList(posting_format_))));
+    }
+    buffer_terms_.clear();
+    buffer_first_ordinal_ = last_ordinal;
+    segments_.push_back(std::move(segment));
+    StartMergeIfNeeded();
+}
+
+void SearchServer::FlushBufferIfNeeded() {
+    if (ordinal_to_document_id_.size() - buffer_first_ordinal_ >= SEGMENT_DOCUMENT_COUNT) {
+        FlushBuffer();
+    }
+}
+
+namespace {
+// уровень сегмента: 0 - меньше SEGMENT_DOCUMENT_COUNT * SEGMENT_MERGE_FACTOR номеров документов,
+// каждый следующий - в SEGMENT_MERGE_FACTOR раз больше
+size_t GetSegmentLevel(const IndexSegment& segment) {
+    size_t level = 0;
+    for (uint64_t size = SEGMENT_DOCUMENT_COUNT * SEGMENT_MERGE_FACTOR;
+        segment.last_ordinal - segment.first_ordinal >= size; size *= SEGMENT_MERGE_FACTOR) {
+        ++level;
+    }
+    return level;
+}
+}
+
+void SearchServer::StartMergeIfNeeded() {
+    if (merge_.valid() || segments_.size() < SEGMENT_MERGE_FACTOR) {
+        return;
+    }
+    // сливаем только последние сегменты и только одного уровня: так каждый документ
+    // переписывается не больше раза на уровень
+    const size_t first_segment = segments_.size() - SEGMENT_MERGE_FACTOR;
+    const size_t level = GetSegmentLevel(*segments_[first_segment]);
+    for (size_t i = first_segment + 1; i < segments_.size(); ++i) {
+        if (GetSegmentLevel(*segments_[i]) != level) {
+            return;
+        }
+    }
+    // слиянию достаются свои копии указателей и отметок удаления: поток не трогает SearchServer
+    std::vector<std::shared_ptr<const IndexSegment>> segments(segments_.begin() + first_segment, segments_.end());
+    merge_first_segment_ = first_segment;
+    merge_ = std::async(std::launch::async,
+        [segments = std::move(segments), is_removed = removed_ordinals_, shard_count = shard_count_, posting_format = posting_format_]() {
+            return MergeSegments(segments, is_removed, shard_count, posting_format);
+        });
+}
+
+void SearchServer::FinishMerge(bool wait) {
+    if (!merge_.valid()
+        || (!wait && merge_.wait_for(std::chrono::seconds(0)) != std::future_status::ready)) {
+        return;
+    }
+    std::shared_ptr<IndexSegment> merged = merge_.get();
+    const auto first_segment = segments_.begin() + merge_first_segment_;
+    segments_.erase(first_segment + 1, first_segment + SEGMENT_MERGE_FACTOR);
+    *first_segment = std::move(merged);
+    StartMergeIfNeeded();
+}
+
+void SearchServer::WaitForMerges() {
+    while (merge_.valid()) {
+        FinishMerge(true);
+    }
+}
+
+size_t SearchServer::GetSegmentCount() const {
+    return segments_.size();
+}
+
+void SearchServer::SaveSnapshot(const std::string& path) const {
+    // номера документов в снимке идут подряд: удаленные выпадают, порядок оставшихся прежний
+    std::vector<uint32_t> snapshot_ordinals(ordinal_to_document_id_.size(), UINT32_MAX);
+    std::vector<SnapshotDocument> documents;
+    documents.reserve(document_ordinals_.size());
+    for (uint32_t ordinal = 0; ordinal < ordinal_to_document_id_.size(); ++ordinal) {
+        if (!removed_ordinals_[ordinal]) {
+            snapshot_ordinals[ordinal] = static_cast<uint32_t>(documents.size());
+            documents.push_back({ ordinal_to_document_id_[ordinal], document_ratings_[ordinal],
+                static_cast<uint32_t>(document_statuses_[ordinal]) });
+        }
+    }
+
+    std::string strings;
+    auto add_string = [&strings](std::string_view text) {
+        const SnapshotString string{ strings.size(), text.size() };
+        strings += text;
+        return string;
+    };
+    std::vector<SnapshotString> stop_words;
+    for (const std::string& stop_word : stop_words_) {
+        stop_words.push_back(add_string(stop_word));
+    }
+
+    std::vector<TermId> term_ids;
+    for (TermId term_id = 0; term_id < term_stats_.size(); ++term_id) {
+        if (term_stats_[term_id].document_count > 0) {
+            term_ids.push_back(term_id);
+        }
+    }
+    std::sort(term_ids.begin(), term_ids.end(), [this](TermId lhs, TermId rhs) {
+        return term_dictionary_.GetTerm(lhs) < term_dictionary_.GetTerm(rhs);
+        });
+    std::vector<SnapshotTerm> terms;
+    terms.reserve(term_ids.size());
+    std::vector<uint32_t> ordinals;
+    std::vector<double> term_freqs;
+    std::vector<Posting> postings;
+    for (const TermId term_id : term_ids) {
+        postings.clear();
+        for (const PostingList* part_postings : GetTermPostings(term_id)) {
+            part_postings->ForEach([&](uint32_t ordinal, double term_freq) {
+                if (!removed_ordinals_[ordinal]) {
+                    postings.push_back({ snapshot_ordinals[ordinal], term_freq });
+                }
+                });
+        }
+        std::sort(postings.begin(), postings.end(), [](const Posting& lhs, const Posting& rhs) {
+            return lhs.ordinal < rhs.ordinal;
+            });
+        terms.push_back({ add_string(term_dictionary_.GetTerm(term_id)), ordinals.size(), postings.size(),
+            ComputeWordInverseDocumentFreq(term_id) });
+        for (const Posting& posting : postings) {
+            ordinals.push_back(posting.ordinal);
+            term_freqs.push_back(posting.term_freq);
+        }
+    }
+
+    SnapshotHeader header{};
+    std::copy(std::begin(SNAPSHOT_MAGIC), std::end(SNAPSHOT_MAGIC), header.magic);
+    header.version = SNAPSHOT_VERSION;
+    header.byte_order_mark = 0x01020304;
+    header.document_count = documents.size();
+    header.term_count = terms.size();
+    header.stop_word_count = stop_words.size();
+    header.posting_count = ordinals.size();
+    header.string_bytes = strings.size();
+    uint64_t offset = sizeof(header);
+    auto place_section = [&offset](size_t byte_count) {
+        offset = (offset + 7) / 8 * 8;
+        const uint64_t section_offset = offset;
+        offset += byte_count;
+        return section_offset;
+    };
+    header.documents_offset = place_section(documents.size() * sizeof(SnapshotDocument));
+    header.terms_offset = place_section(terms.size() * sizeof(SnapshotTerm));
+    header.stop_words_offset = place_section(stop_words.size() * sizeof(SnapshotString));
+    header.ordinals_offset = place_section(ordinals.size() * sizeof(uint32_t));
+    header.term_freqs_offset = place_section(term_freqs.size() * sizeof(double));
+    header.strings_offset = place_section(strings.size());
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    auto write_section = [&out](uint64_t section_offset, const void* data, size_t byte_count) {
+        static const char padding[8] = {};
+        out.write(padding, section_offset - static_cast<uint64_t>(out.tellp()));
+        out.write(static_cast<const char*>(data), byte_count);
+    };
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    write_section(header.documents_offset, documents.data(), documents.size() * sizeof(SnapshotDocument));
+    write_section(header.terms_offset, terms.data(), terms.size() * sizeof(SnapshotTerm));
+    write_section(header.stop_words_offset, stop_words.data(), stop_words.size() * sizeof(SnapshotString));
+    write_section(header.ordinals_offset, ordinals.data(), ordinals.size() * sizeof(uint32_t));
+    write_section(header.term_freqs_offset, term_freqs.data(), term_freqs.size() * sizeof(double));
+    write_section(header.strings_offset, strings.data(), strings.size());
+    if (!out) {
+        throw std::runtime_error("Cannot write snapshot " + path);
+    }
+}
+
+TermDictionary::Stats SearchServer::GetTermDictionaryStats() const {
+    return term_dictionary_.GetStats();
+}
+
+size_t SearchServer::GetPostingMemoryUsage() const {
+    size_t bytes = word_to_document_freqs_.capacity() * sizeof(std::vector<PostingList>);
+    for (const auto& shard_postings : word_to_document_freqs_) {
+        bytes += shard_postings.capacity() * sizeof(PostingList);
+        for (const PostingList& postings : shard_postings) {
+            bytes += postings.GetMemoryUsage();
+        }
+    }
+    bytes += segments_.capacity() * sizeof(std::shared_ptr<IndexSegment>);
+    for (const auto& segment : segments_) {
+        bytes += sizeof(IndexSegment) + segment->GetMemoryUsage();
+    }
+    return bytes;
+}
+
+size_t SearchServer::GetWordPositionMemoryUsage() const {
+    return word_positions_data_.capacity() + word_position_offsets_.capacity() * sizeof(size_t);
 }
 
  const std::map<std::string_view, double>& SearchServer::GetWordFrequencies(int document_id) const {
@@ -168,43 +1344,176 @@ double SearchServer::ComputeWordInverseDocumentFreq(const std::string_view word)
     return empty_map;
 }
 
- void SearchServer::RemoveDocument(int document_id) {
-     std::vector<std::string_view> vec_words;
-     if (document_to_word_freqs_.count(document_id) == 0) {
-         return;
-     }
-     for (const auto& [word,freq] : document_to_word_freqs_.at(document_id)) {
-         word_to_document_freqs_.at(word).erase(document_id);
-         if (word_to_document_freqs_.at(word).empty()) { //удалить если у слова больше нет документов
-             word_to_document_freqs_.erase(word);
-         }
-     }
-     documents_.erase(document_id);
-     document_to_word_freqs_.erase(document_id);
-     document_ids_.erase(document_id);   
- }
+void SearchServer::RemoveDocument(int document_id) {
+    if (MarkDocumentRemoved(document_id)) {
+        UpdateDocumentCountStats();
+        PurgeRemovedDocumentsIfNeeded();
+    }
+}
 
+// списки вхождений при удалении не трогаются, поэтому par версии делить между потоками нечего
 void SearchServer::RemoveDocument(const std::execution::parallel_policy& policy, int document_id) {
-    const auto& words_freqs = GetWordFrequencies(document_id);
-    if (!words_freqs.empty()) {
-        std::vector<std::string_view> words;
-        words.reserve(words_freqs.size());
-        std::for_each(policy, words_freqs.begin(), words_freqs.end(), [&words](auto& wf) {
-            words.push_back(std::string_view(wf.first));
-            });
-        std::for_each(policy, words.begin(), words.end(), [this, document_id](const auto& word) {
-            return word_to_document_freqs_[word].erase(document_id);
-            });
-    }
-    document_ids_.erase(document_id);
-    documents_.erase(document_id);
-    document_to_word_freqs_.erase(document_id);
-    
+    RemoveDocument(document_id);
 }
 
 void SearchServer::RemoveDocument(const std::execution::sequenced_policy& policy, int document_id) {
-    return SearchServer::RemoveDocument(document_id);
+    RemoveDocument(document_id);
 }
 
+void SearchServer::RemoveDocuments(const std::vector<int>& document_ids) {
+    for (const int document_id : document_ids) {
+        MarkDocumentRemoved(document_id);
+    }
+    UpdateDocumentCountStats();
+    PurgeRemovedDocumentsIfNeeded();
+}
 
+void SearchServer::PurgeRemovedDocuments() {
+    // фоновое слияние читает сегменты, менять их можно только после него
+    WaitForMerges();
+    // Оставшиеся документы получают номера подряд в прежнем порядке: списки вхождений остаются отсортированными,
+    // а столбцы документов и окна поиска сжимаются до числа живых документов.
+    // kept_before[ordinal] - сколько оставшихся документов с номером меньше ordinal, это и есть новый номер
+    const uint32_t old_ordinal_count = static_cast<uint32_t>(ordinal_to_document_id_.size());
+    std::vector<uint32_t> kept_before(old_ordinal_count + 1);
+    std::vector<uint32_t> new_ordinals(old_ordinal_count);
+    uint32_t first_removed = old_ordinal_count;
+    for (uint32_t ordinal = 0; ordinal < old_ordinal_count; ++ordinal) {
+        kept_before[ordinal + 1] = kept_before[ordinal] + (removed_ordinals_[ordinal] ? 0 : 1);
+        new_ordinals[ordinal] = removed_ordinals_[ordinal] ? REMOVED_ORDINAL : kept_before[ordinal];
+        if (removed_ordinals_[ordinal] && first_removed == old_ordinal_count) {
+            first_removed = ordinal;
+        }
+    }
+    if (first_removed == old_ordinal_count) {
+        return;
+    }
+    const uint32_t kept_count = kept_before[old_ordinal_count];
 
+    // номера до первого удаленного не меняются, поэтому более ранние сегменты не трогаем.
+    // У каждого слова свои списки вхождений, поэтому потоки друг другу не мешают
+    std::vector<std::vector<PostingList>*> changed_postings;
+    for (const auto& segment : segments_) {
+        if (segment->last_ordinal > first_removed) {
+            for (auto& shard_postings : segment->postings) {
+                changed_postings.push_back(&shard_postings);
+            }
+        }
+    }
+    for (const TermId term_id : buffer_terms_) {
+        changed_postings.push_back(&word_to_document_freqs_[term_id]);
+    }
+    GetThreadPool().ParallelFor(changed_postings.size(), [&](size_t i) {
+        for (PostingList& postings : *changed_postings[i]) {
+            if (postings.Renumber(new_ordinals) > 0) {
+                postings.Compact();
+            }
+        }
+        }, MIN_WORDS_PER_THREAD);
+    for (const TermId term_id : terms_with_removed_) {
+        term_stats_[term_id].has_removed_postings = false;
+    }
+    terms_with_removed_.clear();
+    for (const auto& segment : segments_) {
+        segment->first_ordinal = kept_before[segment->first_ordinal];
+        segment->last_ordinal = kept_before[segment->last_ordinal];
+    }
+    // сегменты, где не осталось ни одного документа, не нужны
+    segments_.erase(std::remove_if(segments_.begin(), segments_.end(), [](const std::shared_ptr<IndexSegment>& segment) {
+        return segment->first_ordinal == segment->last_ordinal;
+        }), segments_.end());
+    buffer_first_ordinal_ = kept_before[buffer_first_ordinal_];
+    for (auto& [document_id, ordinal] : document_ordinals_) {
+        ordinal = new_ordinals[ordinal];
+    }
+
+    // Столбцы сдвигаются к началу на место удаленных. Слова документов и их позиции - тоже: старые границы
+    // документа читаются до того, как его начало переписано на новое
+    const bool has_word_positions = word_positions_ == WordPositions::STORED;
+    size_t kept_term_count = 0;
+    size_t kept_position_bytes = 0;
+    for (uint32_t ordinal = 0; ordinal < old_ordinal_count; ++ordinal) {
+        if (removed_ordinals_[ordinal]) {
+            continue;
+        }
+        const uint32_t new_ordinal = new_ordinals[ordinal];
+        ordinal_to_document_id_[new_ordinal] = ordinal_to_document_id_[ordinal];
+        document_ratings_[new_ordinal] = document_ratings_[ordinal];
+        document_statuses_[new_ordinal] = document_statuses_[ordinal];
+        document_lengths_[new_ordinal] = document_lengths_[ordinal];
+        const size_t first_term = document_term_offsets_[ordinal];
+        const size_t last_term = document_term_offsets_[ordinal + 1];
+        document_term_offsets_[new_ordinal] = kept_term_count;
+        kept_term_count = std::move(document_terms_.begin() + first_term, document_terms_.begin() + last_term,
+            document_terms_.begin() + kept_term_count) - document_terms_.begin();
+        if (has_word_positions) {
+            const size_t first_byte = word_position_offsets_[ordinal];
+            const size_t last_byte = word_position_offsets_[ordinal + 1];
+            word_position_offsets_[new_ordinal] = kept_position_bytes;
+            kept_position_bytes = std::move(word_positions_data_.begin() + first_byte, word_positions_data_.begin() + last_byte,
+                word_positions_data_.begin() + kept_position_bytes) - word_positions_data_.begin();
+        }
+    }
+    auto shrink = [](auto& column, size_t size) {
+        column.resize(size);
+        column.shrink_to_fit();
+    };
+    shrink(ordinal_to_document_id_, kept_count);
+    shrink(document_ratings_, kept_count);
+    shrink(document_statuses_, kept_count);
+    shrink(document_lengths_, kept_count);
+    removed_ordinals_.assign(kept_count, false);
+    removed_ordinals_.shrink_to_fit();
+    for (std::vector<uint64_t>& bitmap : status_bitmaps_) {
+        bitmap.assign((kept_count + 63) / 64, 0);
+        bitmap.shrink_to_fit();
+    }
+    status_document_counts_ = {};
+    for (uint32_t ordinal = 0; ordinal < kept_count; ++ordinal) {
+        status_bitmaps_[static_cast<size_t>(document_statuses_[ordinal])][ordinal >> 6] |= uint64_t{ 1 } << (ordinal & 63);
+        ++status_document_counts_[static_cast<size_t>(document_statuses_[ordinal])];
+    }
+    shrink(document_term_offsets_, kept_count + 1);
+    document_term_offsets_.back() = kept_term_count;
+    shrink(document_terms_, kept_term_count);
+    if (has_word_positions) {
+        shrink(word_position_offsets_, kept_count + 1);
+        word_position_offsets_.back() = kept_position_bytes;
+        shrink(word_positions_data_, kept_position_bytes);
+    }
+    pending_removed_count_ = 0;
+}
+
+bool SearchServer::MarkDocumentRemoved(int document_id) {
+    const auto document = document_ordinals_.find(document_id);
+    if (document == document_ordinals_.end()) {
+        return false;
+    }
+    const uint32_t ordinal = document->second;
+    removed_ordinals_[ordinal] = true;
+    total_document_length_ -= document_lengths_[ordinal];
+    // удаленный документ не проходит ни один фильтр по статусу, отдельно removed_ordinals_ фильтры не спрашивают
+    status_bitmaps_[static_cast<size_t>(document_statuses_[ordinal])][ordinal >> 6] &= ~(uint64_t{ 1 } << (ordinal & 63));
+    --status_document_counts_[static_cast<size_t>(document_statuses_[ordinal])];
+    ++pending_removed_count_;
+    index_version_ = NextIndexVersion();
+    // слово остается в словаре и без документов: его id могут хранить другие структуры
+    for (size_t i = document_term_offsets_[ordinal]; i < document_term_offsets_[ordinal + 1]; ++i) {
+        const TermId term_id = document_terms_[i];
+        UpdateTermStats(term_id, -1);
+        if (!term_stats_[term_id].has_removed_postings) {
+            term_stats_[term_id].has_removed_postings = true;
+            terms_with_removed_.push_back(term_id);
+        }
+    }
+    document_ordinals_.erase(document);
+    document_to_word_freqs_.erase(document_id);
+    document_ids_.erase(document_id);
+    return true;
+}
+
+void SearchServer::PurgeRemovedDocumentsIfNeeded() {
+    if (pending_removed_count_ * REMOVED_PURGE_DIVISOR >= document_ordinals_.size() + pending_removed_count_) {
+        PurgeRemovedDocuments();
+    }
+}
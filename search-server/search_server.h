@@ -1,67 +1,193 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
 #include <string>
 #include <string_view>
 #include <set>
 #include <stdexcept>
 #include <vector>
 #include <map>
+#include <unordered_map>
+#include <unordered_set>
 #include <numeric>
 #include <utility>
 #include <cmath>
 #include <execution>
 #include <functional>
 #include <future>
+#include <optional>
 
 #include "document.h"
+#include "index_segment.h"
 #include "string_processing.h"
 #include "log_duration.h"
-#include "concurrent_map.h"
+#include "posting_list.h"
+#include "relevance_accumulator.h"
+#include "result_cache.h"
+#include "scorer.h"
+#include "term_dictionary.h"
+#include "thread_pool.h"
+#include "top_documents.h"
 
 
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
-const double EPSILON = 1e-6;
-const size_t BUCKETS_NUM = 8; // ÷èñëî ðàçáèåíèé
+const size_t MIN_POSTINGS_PER_THREAD = 8192; // меньше этого параллельный поиск не окупается
+const size_t MIN_WORDS_PER_THREAD = 256; // то же для очистки списков от удаленных документов
+const size_t MIN_DOCUMENTS_PER_THREAD = 64; // то же для AddDocuments
+const size_t PRUNING_WINDOW_SIZE = 4096; // документов в окне поиска с отсечением
+const double PRUNING_SEEK_COST = 4; // во столько раз перескок к кандидату дороже шага по списку вхождений
+const size_t PRUNING_MIN_POSTINGS = 4096; // запрос с меньшим числом вхождений дешевле перебрать целиком
+const size_t REMOVED_PURGE_DIVISOR = 4; // списки вычищаются сами, когда удаленные составят 1/4 документов в них
+const size_t SEGMENT_DOCUMENT_COUNT = 4096; // буфер новых документов сбрасывается в сегмент, набрав столько
+const size_t SEGMENT_MERGE_FACTOR = 4; // столько соседних сегментов одного уровня сливаются в фоне в один
+const size_t BATCH_QUERY_GROUP_SIZE = 64; // запросов, которые FindTopDocumentsBatch считает за один обход списков
+const size_t BATCH_WINDOW_SIZE = 1024; // документов в окне FindTopDocumentsBatch
+const size_t SELECTIVE_FILTER_PERCENT = 80; // фильтр, пропускающий меньше этой доли документов, отбирает вхождения до сложения
+
+// Хранить ли позиции слов в документах. С STORED запрос понимает фразы в кавычках: "white cat"
+enum class WordPositions {
+    DISCARDED,
+    STORED,
+};
 
 class SearchServer {
 public:
+    // shard_count - на сколько частей по id документа делить индекс, см. FindTopDocuments(par, ...);
+    // posting_format - как хранить списки вхождений, см. PostingFormat; word_positions - см. WordPositions
     template <typename StringContainer>
-    SearchServer(const StringContainer& stop_words);
-    SearchServer(const std::string& stop_words_text);
-    SearchServer(const std::string_view stop_words_text);
+    SearchServer(const StringContainer& stop_words, size_t shard_count = 1, PostingFormat posting_format = PostingFormat::PLAIN,
+        WordPositions word_positions = WordPositions::DISCARDED);
+    SearchServer(const std::string& stop_words_text, size_t shard_count = 1, PostingFormat posting_format = PostingFormat::PLAIN,
+        WordPositions word_positions = WordPositions::DISCARDED);
+    SearchServer(const std::string_view stop_words_text, size_t shard_count = 1, PostingFormat posting_format = PostingFormat::PLAIN,
+        WordPositions word_positions = WordPositions::DISCARDED);
+
+    // Глубокая копия: словарь, списки вхождений и сегменты не делятся с other. Незавершенное фоновое слияние
+    // и кеш выдачи other не копируются. Нужна ConcurrentSearchServer, когда прежнюю версию еще держит читатель
+    SearchServer(const SearchServer& other);
+    SearchServer& operator=(const SearchServer&) = delete;
 
     void AddDocument(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+    // Пакетная загрузка: документы разбираются параллельно, списки вхождений дописываются за один проход.
+    // Бросает те же исключения, что AddDocument для первого неподходящего документа, и тогда не добавляет ни одного
+    void AddDocuments(const std::vector<DocumentToAdd>& documents);
 
     template <typename DocumentPredicate>
     std::vector<Document> FindTopDocuments(std::string_view, DocumentPredicate) const;
 
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(std::string_view, DocumentPredicate, size_t top_count) const;
+
     template <class ExecutionPolicy, typename DocumentPredicate>
     std::vector<Document> FindTopDocuments(ExecutionPolicy&&, std::string_view, DocumentPredicate) const;
 
+    template <class ExecutionPolicy, typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy&&, std::string_view, DocumentPredicate, size_t top_count) const;
+
     std::vector<Document> FindTopDocuments(std::string_view, DocumentStatus) const;
 
+    std::vector<Document> FindTopDocuments(std::string_view, DocumentStatus, size_t top_count) const;
+
     template <class ExecutionPolicy>
     std::vector<Document> FindTopDocuments(ExecutionPolicy&&, std::string_view, DocumentStatus) const;
 
+    template <class ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy&&, std::string_view, DocumentStatus, size_t top_count) const;
+
     std::vector<Document> FindTopDocuments(std::string_view) const;
 
     template <class ExecutionPolicy>
     std::vector<Document> FindTopDocuments(ExecutionPolicy&&, std::string_view) const;
 
+    // Отбор по статусу и диапазону рейтинга без предиката: документы проверяются по битовой маске статуса
+    // и столбцу рейтингов прямо при обходе списков, отброшенным релевантность не считается
+    std::vector<Document> FindTopDocuments(std::string_view, const DocumentFilter&,
+        size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    template <class ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy&&, std::string_view, const DocumentFilter&,
+        size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    // Поиск с другой формулой релевантности из scorer.h, например Bm25Scorer(1.2, 0.75).
+    // Scorer встраивается в обход списков при компиляции; такая выдача в кеш не попадает
+    template <typename Scorer, typename = std::enable_if_t<IsScorer<Scorer>::value>>
+    std::vector<Document> FindTopDocuments(std::string_view, const DocumentFilter&, const Scorer&,
+        size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    template <class ExecutionPolicy, typename Scorer, typename = std::enable_if_t<IsScorer<Scorer>::value>>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy&&, std::string_view, const DocumentFilter&, const Scorer&,
+        size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    // Пачка запросов с одним статусом и top_count. Запросы делятся на группы по BATCH_QUERY_GROUP_SIZE,
+    // группы считаются параллельно в пуле. В группе каждый список вхождений обходится один раз,
+    // и вклад слова раздается всем запросам группы, где оно есть. Результат тот же, что у FindTopDocuments,
+    // и так же берется из кеша выдачи и кладется в него, если кеш задан
+    std::vector<std::vector<Document>> FindTopDocumentsBatch(const std::vector<std::string>& raw_queries,
+        DocumentStatus status = DocumentStatus::ACTUAL, size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    // Поиск по умолчанию пропускает документы, которые по верхним границам вклада слов (MaxScore)
+    // не могут попасть в выдачу; результат тот же, что при полном переборе. false - перебирать все документы
+    void SetPruning(bool is_enabled);
+
+    // пул, на котором выполняются par версии методов и ProcessQueries; по умолчанию общий ThreadPool::GetDefault()
+    void SetThreadPool(std::shared_ptr<ThreadPool> thread_pool);
+    ThreadPool& GetThreadPool() const;
+
+    // Кеш выдачи поиска по статусу (см. ResultCache); nullptr - без кеша, так по умолчанию.
+    // Любое добавление или удаление документа делает прежние записи промахами. Один кеш можно отдать
+    // нескольким серверам: записи помнят версию индекса, а версии у серверов разные
+    void SetResultCache(std::shared_ptr<ResultCache> result_cache);
+
     int GetDocumentCount() const;
 
+    // Массовая загрузка: пока она идет, AddDocument и RemoveDocument не пересчитывают кеш IDF,
+    // поиск видит IDF на момент BeginBulkLoad. CommitBulkLoad пересчитывает только затронутые слова
+    void BeginBulkLoad();
+    void CommitBulkLoad();
+
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::string_view raw_query, int document_id) const;
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::execution::parallel_policy& policy,
         const std::string_view raw_query, int document_id) const;
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument (const std::execution::sequenced_policy& policy,
         const std::string_view raw_query, int document_id) const;
+    // MatchDocument для многих документов: запрос разбирается один раз, документы проверяются параллельно в пуле
+    std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> MatchDocuments(const std::string_view raw_query,
+        const std::vector<int>& document_ids) const;
 
     const std::map<std::string_view, double>& GetWordFrequencies(int document_id) const;
 
+    // Сохраняет индекс в файл, который открывает MappedIndex (index_snapshot.h).
+    // Номера документов в снимке уплотняются, шарды сливаются в один список; позиции слов в снимок не попадают,
+    // поэтому фраз MappedIndex не понимает: кавычка в его запросе - обычный символ слова
+    void SaveSnapshot(const std::string& path) const;
+
+    // память, занятая словарем слов индекса
+    TermDictionary::Stats GetTermDictionaryStats() const;
+    // память, занятая списками вхождений, в байтах
+    size_t GetPostingMemoryUsage() const;
+    // то же для позиций слов; 0 без WordPositions::STORED
+    size_t GetWordPositionMemoryUsage() const;
+
+    // Индекс состоит из неизменяемых сегментов и буфера, куда попадают новые документы. Буфер сбрасывается
+    // в сегмент сам, набрав SEGMENT_DOCUMENT_COUNT документов; когда SEGMENT_MERGE_FACTOR последних сегментов
+    // оказываются одного уровня (размера), они сливаются в фоновом потоке, не задерживая ни поиск, ни запись.
+    // Готовое слияние подключает следующий изменяющий вызов. IDF по-прежнему общий для всего индекса
+    void FlushBuffer();
+    // дожидается фоновых слияний и подключает их результат
+    void WaitForMerges();
+    size_t GetSegmentCount() const;
+
+    // Удаление только помечает документ: поиск пропускает его сразу, а вхождения вычищаются
+    // из списков пачкой в PurgeRemovedDocuments - явно или когда удаленных накопится много
     void RemoveDocument(int document_id);
     void RemoveDocument(const std::execution::parallel_policy& policy, int document_id);
     void RemoveDocument(const std::execution::sequenced_policy& policy, int document_id);
+    // несуществующие id пропускаются, как в RemoveDocument
+    void RemoveDocuments(const std::vector<int>& document_ids);
+    // убирает помеченные документы из списков вхождений и столбцов документов, оставшиеся получают номера подряд;
+    // списки обрабатываются параллельно в пуле
+    void PurgeRemovedDocuments();
     auto begin() const {
         return document_ids_.begin();
     }
@@ -71,22 +197,103 @@ public:
 
 
 private:
-    struct DocumentData {
-        int rating;
-        DocumentStatus status;
-    };
     const std::set<std::string, std::less<>> stop_words_;
   
-    std::set<std::string, std::less<>>document_words_set_;
-    std::map<std::string_view, std::map<int, double>> word_to_document_freqs_;
+    TermDictionary term_dictionary_;
+    // Буфер: списки вхождений документов, добавленных после последнего сброса в сегмент.
+    // Индекс - id слова в term_dictionary_. У каждого шарда свой список вхождений слова,
+    // IDF при этом считается по всем шардам
+    std::vector<std::vector<PostingList>> word_to_document_freqs_;
+    std::vector<TermId> buffer_terms_;  // слова с TermStats::is_in_buffer
+    uint32_t buffer_first_ordinal_ = 0;
+    std::vector<std::shared_ptr<IndexSegment>> segments_;  // по возрастанию номеров документов
+    // фоновое слияние сегментов [merge_first_segment_, merge_first_segment_ + SEGMENT_MERGE_FACTOR)
+    std::future<std::shared_ptr<IndexSegment>> merge_;
+    size_t merge_first_segment_ = 0;
+
+    // IDF = log(N / df) хранится разложенным на log(N) - log(df): при добавлении документа
+    // меняется только log(df) его слов, а не IDF всех слов словаря
+    struct TermStats {
+        uint32_t document_count = 0;    // df по всем шардам
+        double log_document_count = 0;
+        bool is_stale = false;          // df изменился во время массовой загрузки
+        double max_term_freq = 0;       // наибольший tf слова; после удаления документов может быть завышен
+        bool has_removed_postings = false;  // в списках слова остались удаленные документы
+        bool is_in_buffer = false;          // у слова есть вхождения в буфере
+    };
+    std::vector<TermStats> term_stats_;  // индекс - id слова
+    double log_document_count_ = 0;     // log(N)
+    bool is_bulk_load_ = false;
+    bool is_pruning_enabled_ = true;
+    std::shared_ptr<ResultCache> result_cache_;
+    // Меняется при каждом изменении выдачи, см. ResultCache. Версии берутся из общего для процесса счетчика,
+    // поэтому у разных серверов они не совпадают, и записи одного кеша от разных серверов не путаются
+    uint64_t index_version_ = NextIndexVersion();
+    std::vector<TermId> stale_terms_;
+    const size_t shard_count_;
+    const PostingFormat posting_format_;
+    const WordPositions word_positions_;
+    std::shared_ptr<ThreadPool> thread_pool_ = ThreadPool::GetDefault();
     std::map <int, std::map<std::string_view, double>> document_to_word_freqs_;
-    std::map<int, DocumentData> documents_;
+    std::map<int, uint32_t> document_ordinals_;  // id -> номер документа, только не удаленные
+    // Номер документа - его место в порядке добавления. Удаленный сохраняет номер до PurgeRemovedDocuments,
+    // которая нумерует оставшиеся заново подряд; поэтому хранить номера вне поиска нельзя
+    std::vector<int> ordinal_to_document_id_;
+    std::vector<bool> removed_ordinals_;       // индекс - номер документа
+    // Свойства документов столбцами по номеру документа, чтобы поиск не ходил в map.
+    // В маске статуса удаленный документ сброшен, поэтому один бит отвечает и за статус, и за удаление
+    std::vector<int> document_ratings_;
+    std::vector<DocumentStatus> document_statuses_;
+    std::vector<uint32_t> document_lengths_;  // слов без стоп-слов, для Bm25Scorer
+    uint64_t total_document_length_ = 0;      // сумма длин неудаленных документов
+    std::array<std::vector<uint64_t>, DOCUMENT_STATUS_COUNT> status_bitmaps_;
+    std::array<size_t, DOCUMENT_STATUS_COUNT> status_document_counts_ = {};  // единиц в масках статусов
+    // id слов документов подряд, у каждого документа по возрастанию id: слова документа с номером ordinal -
+    // [document_term_offsets_[ordinal], document_term_offsets_[ordinal + 1]). Слова удаленных вычищает PurgeRemovedDocuments
+    std::vector<TermId> document_terms_;
+    std::vector<size_t> document_term_offsets_ = { 0 };
+    // Только с WordPositions::STORED. Позиции слов документа с номером ordinal (считая стоп-слова) - байты
+    // [word_position_offsets_[ordinal], word_position_offsets_[ordinal + 1]) в word_positions_data_: по слову
+    // в порядке document_terms_ длина списка в байтах и разности соседних позиций по возрастанию.
+    // Числа - по 7 бит в байте, старший бит - продолжение числа
+    std::vector<uint8_t> word_positions_data_;
+    std::vector<size_t> word_position_offsets_;
+    std::vector<TermId> terms_with_removed_;   // слова с has_removed_postings
+    size_t pending_removed_count_ = 0;         // удаленные документы, чьи вхождения еще лежат в списках
     std::set<int> document_ids_;
 
-    double ComputeWordInverseDocumentFreq(const std::string_view word) const; 
+    static uint64_t NextIndexVersion();
+    double ComputeWordInverseDocumentFreq(TermId term_id) const;
+    // заводит документ с очередным номером во всех структурах, кроме списков вхождений и слов документа
+    void AppendDocument(int document_id, DocumentStatus status, int rating, uint32_t document_length);
+    CorpusStats GetCorpusStats() const;
+    // дописывает позиции слов последнего добавленного документа; его слова уже в document_terms_
+    void AppendWordPositions(std::string_view document);
+    // помечает документ удаленным и пересчитывает df его слов; false, если такого документа нет
+    bool MarkDocumentRemoved(int document_id);
+    void PurgeRemovedDocumentsIfNeeded();
+
+    // Часть индекса - шард сегмента или буфера: part = номер сегмента * shard_count_ + шард, буфер - последний
+    size_t GetPartCount() const;
+    // [first_ordinal, last_ordinal) документов части
+    std::pair<uint32_t, uint32_t> GetPartOrdinals(size_t part) const;
+    // списки вхождений слова во всех частях по порядку; где слова нет - пустой список
+    std::vector<const PostingList*> GetTermPostings(TermId term_id) const;
+    void AddBufferTerm(TermId term_id);
+    void FlushBufferIfNeeded();
+    void StartMergeIfNeeded();
+    // подключает результат фонового слияния; если wait = false, только уже готовый
+    void FinishMerge(bool wait);
+    void UpdateTermStats(TermId term_id, int document_count_delta);
+    void UpdateDocumentCountStats();
+    size_t GetShardIndex(int document_id) const;
     bool IsStopWord(const std::string_view word) const;
     static bool IsValidWord(const std::string_view word);
-    std::vector<std::string_view> SplitIntoWordsNoStop(const std::string_view text) const;
+    // SplitIntoWords для текста документа: номер первого недопустимого слова или NO_INVALID_WORD.
+    // С WordPositions::STORED недопустима и кавычка - в запросе она граница фразы, такое слово не найти
+    size_t SplitDocumentIntoWords(const std::string_view text, std::vector<std::string_view>& words) const;
+    // слова text без стоп-слов; буфер words переиспользуется
+    void SplitIntoWordsNoStop(const std::string_view text, std::vector<std::string_view>& words) const;
     static int ComputeAverageRating(const std::vector<int>& ratings);
 
     struct QueryWord {
@@ -95,34 +302,161 @@ private:
         bool is_stop;
     };
 
-    QueryWord ParseQueryWord(const std::string_view text) const;
+    // may_be_invalid = false, если управляющих символов в слове точно нет
+    QueryWord ParseQueryWord(const std::string_view text, bool may_be_invalid) const;
+
+    // слово запроса, уже найденное в индексе: дальше по строке его никто не ищет
+    struct QueryTerm {
+        TermId term_id;
+        std::vector<const PostingList*> part_postings;  // индекс - часть индекса
+        double inverse_document_freq;  // в поиске со Scorer - вес слова от Scorer::GetTermWeight
+    };
+    // слово фразы в кавычках; offset - место в фразе, стоп-слова тоже занимают место
+    struct PhraseTerm {
+        TermId term_id;  // INVALID_TERM_ID, если слова нет ни в одном документе - тогда фразы нет нигде
+        uint32_t offset;
+    };
+    // слова без единого документа в запрос не попадают; порядок - лексикографический, без повторов
     struct Query {
-        std::vector<std::string_view> plus_words;
-        std::vector<std::string_view> minus_words;
+        std::vector<QueryTerm> plus_terms;
+        std::vector<QueryTerm> minus_terms;
+        // документ должен содержать каждую фразу; слова фраз есть и в plus_terms. Только с WordPositions::STORED
+        std::vector<std::vector<PhraseTerm>> phrases;
     };
 
-    template <class ExecutionPolicy>
-    Query ParseQuery(ExecutionPolicy&&, std::string_view) const;
+    // with_postings = false - без списков вхождений в QueryTerm, когда нужны только id слов
+    Query ParseQuery(std::string_view, bool with_postings = true) const;
+    std::vector<QueryTerm> ResolveQueryTerms(std::vector<std::string_view>& words, bool with_postings) const;
+
+    // запрос MatchDocument: id слов по возрастанию для пересечения со словами документа
+    struct MatchQuery {
+        std::vector<TermId> minus_term_ids;
+        std::vector<TermId> plus_term_ids;
+        std::vector<uint32_t> plus_word_indices;  // место слова plus_term_ids[i] в plus_words
+        std::vector<std::string_view> plus_words; // по алфавиту
+        std::vector<std::vector<PhraseTerm>> phrases;
+    };
+    MatchQuery ParseMatchQuery(std::string_view) const;
+    // документ должен существовать
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchParsedQuery(const MatchQuery& query, int document_id) const;
+    static ResultCache::Key MakeResultCacheKey(const Query& query, const DocumentFilter& filter, size_t top_count);
+
+    // Отбор документов при поиске по номеру документа. Дешевую проверку (IS_CHEAP) поиск делает на каждом
+    // вхождении и не копит релевантность отброшенным; остальные - один раз на документ-кандидат.
+    // Дешевая проверка без ветвлений; если она отсекает заметную часть документов (IsSelective),
+    // вхождения сначала отбираются подряд в буфер, и в накопитель идут только прошедшие
+    template <typename DocumentPredicate>
+    struct PredicateFilter {
+        static constexpr bool IS_CHEAP = false;
+        const SearchServer& search_server;
+        DocumentPredicate& document_predicate;
+
+        bool operator()(uint32_t ordinal) const {
+            return !search_server.removed_ordinals_[ordinal]
+                && document_predicate(search_server.ordinal_to_document_id_[ordinal],
+                    search_server.document_statuses_[ordinal], search_server.document_ratings_[ordinal]);
+        }
+    };
+    struct ColumnFilter {
+        static constexpr bool IS_CHEAP = true;
+        const uint64_t* status_bits;
+        const int* ratings;
+        int min_rating;
+        int max_rating;
+        bool has_rating_range;
+
+        bool is_selective;
+
+        bool operator()(uint32_t ordinal) const {
+            const int rating = ratings[ordinal];
+            return ((status_bits[ordinal >> 6] >> (ordinal & 63)) & 1)
+                & ((!has_rating_range) | ((rating >= min_rating) & (rating <= max_rating)));
+        }
+        bool IsSelective() const {
+            return is_selective;
+        }
+    };
+    ColumnFilter MakeColumnFilter(const DocumentFilter& filter) const;
+    // фразы запроса как еще одно условие отбора: бит документа в phrase_bits стоит, если в нем есть все фразы
+    template <typename OrdinalFilter>
+    struct PhraseFilter {
+        static constexpr bool IS_CHEAP = OrdinalFilter::IS_CHEAP;
+        OrdinalFilter document_filter;
+        const uint64_t* phrase_bits;
+
+        bool operator()(uint32_t ordinal) const {
+            return ((phrase_bits[ordinal >> 6] >> (ordinal & 63)) & 1) & document_filter(ordinal);
+        }
+        // фразы есть у немногих документов
+        bool IsSelective() const {
+            return true;
+        }
+    };
+    // Документы со всеми фразами запроса, битами по номеру документа. Сначала списки вхождений слов фраз
+    // пересекаются перескоками по номерам документов, позиции читаются только у документов со всеми словами
+    std::vector<uint64_t> FindPhraseDocuments(const Query& query) const;
+    bool ContainsPhrase(uint32_t ordinal, const std::vector<PhraseTerm>& phrase) const;
+    // позиции по возрастанию слова, которое в документе с номером ordinal стоит term_index-м в document_terms_
+    void DecodeWordPositions(uint32_t ordinal, size_t term_index, std::vector<uint32_t>& positions) const;
+    // FindAllDocuments с учетом фраз запроса
+    template <class ExecutionPolicy, typename OrdinalFilter, typename Scorer = TfIdfScorer>
+    TopDocuments FindQueryDocuments(ExecutionPolicy&& policy, const Query& query, OrdinalFilter document_filter,
+        size_t top_count, const Scorer& scorer = {}) const;
+    // считает группу запросов FindTopDocumentsBatch, matched_documents[i] - выдача запроса queries[i]
+    void ScoreQueryGroup(const std::vector<Query>& queries, const ColumnFilter& document_filter, const TfIdfScorer& scorer,
+        std::vector<TopDocuments>& matched_documents) const;
   
     
    
-    template <typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(std::execution::sequenced_policy,const Query&,DocumentPredicate) const;
-
-    template <typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(std::execution::parallel_policy,const Query&,DocumentPredicate) const;
+    template <typename OrdinalFilter>
+    static bool IsSelectiveFilter(const OrdinalFilter& document_filter);
+    // складывает вклад слова в документы из [first_ordinal, last_ordinal); is_filtered - IsSelectiveFilter фильтра
+    template <typename OrdinalFilter, typename Scorer>
+    void AccumulateTerm(const PostingList& postings, double term_weight, OrdinalFilter& document_filter, const Scorer& scorer,
+        bool is_filtered, uint32_t first_ordinal, uint32_t last_ordinal, RelevanceAccumulator& document_to_relevance) const;
+
+    template <typename OrdinalFilter, typename Scorer>
+    void FindDocumentsInRange(const Query&, OrdinalFilter&, const Scorer&, size_t part, uint32_t first_ordinal, uint32_t last_ordinal,
+        TopDocuments& matched_documents) const;
+
+    template <typename OrdinalFilter, typename Scorer>
+    void FindDocumentsPruned(const Query&, OrdinalFilter&, const Scorer&, size_t part, uint32_t first_ordinal, uint32_t last_ordinal,
+        TopDocuments& matched_documents) const;
+
+    // выбирает между полным перебором и MaxScore
+    template <typename OrdinalFilter, typename Scorer>
+    void ScoreDocuments(const Query&, OrdinalFilter&, const Scorer&, size_t part, uint32_t first_ordinal, uint32_t last_ordinal,
+        TopDocuments& matched_documents) const;
+
+    template <typename OrdinalFilter, typename Scorer = TfIdfScorer>
+    TopDocuments FindAllDocuments(std::execution::sequenced_policy,const Query&,OrdinalFilter,size_t top_count,
+        const Scorer& scorer = {}) const;
+
+    template <typename OrdinalFilter, typename Scorer = TfIdfScorer>
+    TopDocuments FindAllDocuments(std::execution::parallel_policy,const Query&,OrdinalFilter,size_t top_count,
+        const Scorer& scorer = {}) const;
  
-    template <typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(const Query&,DocumentPredicate) const;
+    template <typename OrdinalFilter, typename Scorer = TfIdfScorer>
+    TopDocuments FindAllDocuments(const Query&,OrdinalFilter,size_t top_count, const Scorer& scorer = {}) const;
 };
 
 template <typename StringContainer>
-SearchServer::SearchServer(const StringContainer& stop_words)
+SearchServer::SearchServer(const StringContainer& stop_words, size_t shard_count, PostingFormat posting_format,
+    WordPositions word_positions)
     : stop_words_(MakeUniqueNonEmptyStrings(stop_words))  // Extract non-empty stop words
+    , shard_count_(shard_count)
+    , posting_format_(posting_format)
+    , word_positions_(word_positions)
 {
     if (!all_of(stop_words_.begin(), stop_words_.end(), IsValidWord)) {
         throw std::invalid_argument("Some of stop words are invalid");
     }
+    if (shard_count_ == 0) {
+        throw std::invalid_argument("Shard count must be positive");
+    }
+    if (word_positions_ == WordPositions::STORED) {
+        word_position_offsets_.push_back(0);
+    }
 }
 
 
@@ -133,38 +467,82 @@ std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query,
     return FindTopDocuments(std::execution::seq, raw_query, document_predicate);
 }
 
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query,
+    DocumentPredicate document_predicate, size_t top_count) const
+{
+    return FindTopDocuments(std::execution::seq, raw_query, document_predicate, top_count);
+}
+
 template <class ExecutionPolicy, typename DocumentPredicate>
 std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy,
     std::string_view raw_query,
     DocumentPredicate document_predicate) const
 {
-    const auto query = ParseQuery(policy, raw_query);
-
-    auto matched_documents = FindAllDocuments(policy, query, document_predicate);
+    return FindTopDocuments(policy, raw_query, document_predicate, MAX_RESULT_DOCUMENT_COUNT);
+}
 
-    std::sort(policy, matched_documents.begin(), matched_documents.end(),
-        [](const Document& lhs, const Document& rhs)
-        {
-            return lhs.relevance > rhs.relevance
-                || (std::abs(lhs.relevance - rhs.relevance) < EPSILON && lhs.rating > rhs.rating);
-        });
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT)
-    {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
-    }
+template <class ExecutionPolicy, typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy,
+    std::string_view raw_query,
+    DocumentPredicate document_predicate, size_t top_count) const
+{
+    const auto query = ParseQuery(raw_query);
 
-    return matched_documents;
+    // сортировка всех найденных не нужна - отбираем лучшие прямо при обходе
+    return FindQueryDocuments(policy, query, PredicateFilter<DocumentPredicate>{ *this, document_predicate }, top_count).Extract();
 }
 
 
 template <class ExecutionPolicy>
 std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query, DocumentStatus status) const
 {
-    return FindTopDocuments(policy,
-        raw_query, [status](int document_id, DocumentStatus document_status, int rating)
-        {
-            return document_status == status;
-        });
+    return FindTopDocuments(policy, raw_query, status, MAX_RESULT_DOCUMENT_COUNT);
+}
+
+template <class ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query, DocumentStatus status,
+    size_t top_count) const
+{
+    return FindTopDocuments(policy, raw_query, DocumentFilter{ status }, top_count);
+}
+
+template <class ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query,
+    const DocumentFilter& filter, size_t top_count) const
+{
+    const auto query = ParseQuery(raw_query);
+    if (!result_cache_) {
+        return FindQueryDocuments(policy, query, MakeColumnFilter(filter), top_count).Extract();
+    }
+    ResultCache::Key key = MakeResultCacheKey(query, filter, top_count);
+    std::vector<Document> documents;
+    if (!result_cache_->Find(key, index_version_, documents)) {
+        documents = FindQueryDocuments(policy, query, MakeColumnFilter(filter), top_count).Extract();
+        result_cache_->Insert(std::move(key), index_version_, documents);
+    }
+    return documents;
+}
+
+template <typename Scorer, typename>
+std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, const DocumentFilter& filter,
+    const Scorer& scorer, size_t top_count) const
+{
+    return FindTopDocuments(std::execution::seq, raw_query, filter, scorer, top_count);
+}
+
+template <class ExecutionPolicy, typename Scorer, typename>
+std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query,
+    const DocumentFilter& filter, const Scorer& scorer, size_t top_count) const
+{
+    auto query = ParseQuery(raw_query);
+    const Scorer prepared_scorer = scorer.Prepare(GetCorpusStats());
+    // дальше поиск знает только вес слова, для TfIdfScorer это тот же IDF
+    for (QueryTerm& term : query.plus_terms) {
+        term.inverse_document_freq = prepared_scorer.GetTermWeight(term_stats_[term.term_id].document_count,
+            term.inverse_document_freq);
+    }
+    return FindQueryDocuments(policy, query, MakeColumnFilter(filter), top_count, prepared_scorer).Extract();
 }
 
 template <class ExecutionPolicy>
@@ -175,137 +553,416 @@ std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, s
 
 
 
-template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(std::execution::sequenced_policy policy,
-    const SearchServer::Query& query,
-    DocumentPredicate document_predicate) const
+template <class ExecutionPolicy, typename OrdinalFilter, typename Scorer>
+TopDocuments SearchServer::FindQueryDocuments(ExecutionPolicy&& policy, const SearchServer::Query& query,
+    OrdinalFilter document_filter, size_t top_count, const Scorer& scorer) const
+{
+    if (query.phrases.empty())
+    {
+        return FindAllDocuments(policy, query, document_filter, top_count, scorer);
+    }
+    const std::vector<uint64_t> phrase_bits = FindPhraseDocuments(query);
+    return FindAllDocuments(policy, query, PhraseFilter<OrdinalFilter>{ document_filter, phrase_bits.data() }, top_count, scorer);
+}
+
+template <typename OrdinalFilter>
+bool SearchServer::IsSelectiveFilter(const OrdinalFilter& document_filter)
+{
+    if constexpr (OrdinalFilter::IS_CHEAP)
+    {
+        return document_filter.IsSelective();
+    }
+    return false;
+}
+
+template <typename OrdinalFilter, typename Scorer>
+void SearchServer::AccumulateTerm(const PostingList& postings, double term_weight, OrdinalFilter& document_filter,
+    const Scorer& scorer, bool is_filtered, uint32_t first_ordinal, uint32_t last_ordinal,
+    RelevanceAccumulator& document_to_relevance) const
 {
-    std::vector<Document> matched_documents;
-    std::map<int, double> document_to_relevance;
-    for (std::string_view word : query.plus_words)
+    if (is_filtered)
     {
-        if (word_to_document_freqs_.count(word) == 0)
+        // Ветвление по редко проходящей проверке предсказывается плохо. Поэтому сначала вхождения слова
+        // отбираются без ветвлений: каждое пишется в буфер, а позиция сдвигается, только если документ прошел
+        static thread_local std::vector<Posting> passed;
+        if (passed.size() < postings.size())
         {
-            continue;
+            passed.resize(postings.size());
         }
-        const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-        for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word))
+        Posting* const passed_data = passed.data();
+        size_t passed_count = 0;
+        postings.ForEachInRange(first_ordinal, last_ordinal,
+            [&document_to_relevance, &document_filter, passed_data, &passed_count](uint32_t ordinal, double term_freq)
+            {
+                passed_data[passed_count] = { ordinal, term_freq };
+                passed_count += document_filter(ordinal) & !document_to_relevance.IsExcluded(ordinal);
+            });
+        for (size_t i = 0; i < passed_count; ++i)
+        {
+            document_to_relevance.Add(passed_data[i].ordinal, scorer.Score(passed_data[i].ordinal, passed_data[i].term_freq, term_weight));
+        }
+        return;
+    }
+    postings.ForEachInRange(first_ordinal, last_ordinal,
+        [&document_to_relevance, &document_filter, &scorer, term_weight](uint32_t ordinal, double term_freq)
         {
-            const auto& document_data = documents_.at(document_id);
-            if (document_predicate(document_id, document_data.status, document_data.rating))
+            if (!document_to_relevance.IsExcluded(ordinal) && (!OrdinalFilter::IS_CHEAP || document_filter(ordinal)))
             {
-                document_to_relevance[document_id] += term_freq * inverse_document_freq;
+                document_to_relevance.Add(ordinal, scorer.Score(ordinal, term_freq, term_weight));
             }
-        }
+        });
+}
+
+template <typename OrdinalFilter, typename Scorer>
+void SearchServer::FindDocumentsInRange(const SearchServer::Query& query, OrdinalFilter& document_filter, const Scorer& scorer,
+    size_t part, uint32_t first_ordinal, uint32_t last_ordinal, TopDocuments& matched_documents) const
+{
+    RelevanceAccumulator& document_to_relevance = GetThreadRelevanceAccumulator();
+    document_to_relevance.Reset(ordinal_to_document_id_.size());
+    // минус-слова отмечаем заранее, чтобы не считать релевантность исключенным документам
+    for (const QueryTerm& term : query.minus_terms)
+    {
+        term.part_postings[part]->ForEachInRange(first_ordinal, last_ordinal,
+            [&document_to_relevance](uint32_t ordinal, double term_freq)
+            {
+                document_to_relevance.Exclude(ordinal);
+            });
     }
-    for (std::string_view word : query.minus_words)
+    const bool is_filtered = IsSelectiveFilter(document_filter);
+    for (const QueryTerm& term : query.plus_terms)
     {
-        if (word_to_document_freqs_.count(word) == 0)
-        {
-            continue;
-        }
-        for (const auto [document_id, _] : word_to_document_freqs_.at(word))
+        AccumulateTerm(*term.part_postings[part], term.inverse_document_freq, document_filter, scorer, is_filtered,
+            first_ordinal, last_ordinal, document_to_relevance);
+    }
+    // предикат проверяем один раз на документ, а не на каждое вхождение слова
+    for (const uint32_t ordinal : document_to_relevance.GetTouched())
+    {
+        if (OrdinalFilter::IS_CHEAP || document_filter(ordinal))
         {
-            document_to_relevance.erase(document_id);
+            matched_documents.Push({ ordinal_to_document_id_[ordinal], document_to_relevance.GetRelevance(ordinal),
+                document_ratings_[ordinal] });
         }
     }
-    for (const auto [document_id, relevance] : document_to_relevance)
+}
+
+template <typename OrdinalFilter, typename Scorer>
+void SearchServer::FindDocumentsPruned(const SearchServer::Query& query, OrdinalFilter& document_filter, const Scorer& scorer,
+    size_t part, uint32_t first_ordinal, uint32_t last_ordinal, TopDocuments& matched_documents) const
+{
+    RelevanceAccumulator& document_to_relevance = GetThreadRelevanceAccumulator();
+    document_to_relevance.Reset(ordinal_to_document_id_.size());
+    for (const QueryTerm& term : query.minus_terms)
     {
-        matched_documents.push_back(
-            { document_id, relevance, documents_.at(document_id).rating });
+        term.part_postings[part]->ForEachInRange(first_ordinal, last_ordinal,
+            [&document_to_relevance](uint32_t ordinal, double term_freq)
+            {
+                document_to_relevance.Exclude(ordinal);
+            });
     }
-    return matched_documents;
-}
+    const bool is_filtered = IsSelectiveFilter(document_filter);
 
+    // Слова упорядочены по возрастанию верхней границы вклада max_score. Первые first_essential
+    // слов в сумме не дотягивают до худшего документа выдачи: документ, который есть только в них,
+    // в выдачу не попадет, поэтому кандидаты берутся лишь из остальных списков
+    struct PrunedTerm
+    {
+        double max_score;
+        size_t term_index;  // номер в query.plus_terms - в этом порядке складывается релевантность
+        // курсор необязательного слова; заводится на первом проверяемом документе
+        std::optional<PostingList::Cursor> cursor;
+    };
+    const size_t term_count = query.plus_terms.size();
+    std::vector<PrunedTerm> terms;
+    terms.reserve(term_count);
+    for (size_t i = 0; i < term_count; ++i)
+    {
+        const QueryTerm& term = query.plus_terms[i];
+        terms.push_back({ std::max(0.0, scorer.GetMaxScore(term_stats_[term.term_id].max_term_freq, term.inverse_document_freq)),
+            i, std::nullopt });
+    }
+    std::sort(terms.begin(), terms.end(),
+        [](const PrunedTerm& lhs, const PrunedTerm& rhs)
+        {
+            return lhs.max_score < rhs.max_score;
+        });
+    std::vector<double> max_score_prefix(term_count);
+    std::vector<size_t> term_positions(term_count);  // номер слова запроса -> его место в terms
+    for (size_t i = 0; i < term_count; ++i)
+    {
+        max_score_prefix[i] = (i > 0 ? max_score_prefix[i - 1] : 0.0) + terms[i].max_score;
+        term_positions[terms[i].term_index] = i;
+    }
 
-template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(std::execution::parallel_policy policy,
-    const SearchServer::Query& query,
-    DocumentPredicate document_predicate) const
-{
-    std::vector<Document> matched_documents;
-    ConcurrentMap<int, double> document_to_relevance(BUCKETS_NUM);
-    std::for_each(policy, query.plus_words.begin(),query.plus_words.end(),
-        [this, &document_to_relevance, &document_predicate](std::string_view word)
+    // документ обходит худший из выдачи, только если его релевантность больше worst - EPSILON
+    // (при меньшей разнице решает рейтинг); еще EPSILON - запас на округление сумм границ
+    double min_score = -1.0;
+    size_t first_essential = 0;
+    std::vector<double> term_scores(term_count);  // вклады необязательных слов в текущий документ
+    // курсоры для точного пересчета; заводятся при первой надобности
+    std::vector<std::optional<PostingList::Cursor>> exact_cursors(term_count);
+    std::vector<bool> is_skipped(term_count);  // по номеру слова запроса: слово окна необязательное
+    std::vector<size_t> skipped_terms;          // места в terms необязательных слов окна, по возрастанию границы
+    std::vector<double> skipped_score_prefix;   // суммы их границ
+    std::vector<size_t> candidate_terms;        // места в terms слов из отсеченных границей, по возрастанию длины
+    const double part_size = last_ordinal - first_ordinal;
+
+    // Окно за окном: обязательные списки складываются в накопитель в порядке слов запроса тем же проходом,
+    // что и полный перебор, необязательные проверяются перескоком только у документов, которые еще могут пройти
+    for (uint32_t window_first = first_ordinal; window_first < last_ordinal;)
+    {
+        const uint32_t window_last = window_first + static_cast<uint32_t>(
+            std::min<size_t>(PRUNING_WINDOW_SIZE, last_ordinal - window_first));
+        if (matched_documents.IsFull())
+        {
+            min_score = matched_documents.GetWorst().relevance - 2 * EPSILON;
+        }
+        while (first_essential < term_count && max_score_prefix[first_essential] < min_score)
         {
-            if (!word_to_document_freqs_.count(word) == 0)
+            ++first_essential;
+        }
+        if (first_essential == term_count)
+        {
+            break;
+        }
+        // Граница разрешает не складывать первые first_essential слов, но перескок по списку дороже
+        // прохода по нему, если кандидатов не намного меньше его вхождений. Поэтому необязательным
+        // остается только слово, вхождений которого в окне (по оценке) больше PRUNING_SEEK_COST
+        // на кандидата; кандидаты - вхождения обязательных слов, но не больше документов окна
+        const double window_share = (window_last - window_first) / part_size;
+        auto estimate_postings = [&](size_t position)
             {
-                const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-                for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word))
-                {
-                    const auto& document_data = documents_.at(document_id);
-                    if (document_predicate(document_id, document_data.status, document_data.rating))
-                    {
-                        document_to_relevance[document_id] += term_freq * inverse_document_freq;
-                    }
-                }
+                return query.plus_terms[terms[position].term_index].part_postings[part]->size() * window_share;
+            };
+        double candidate_count = 0;
+        for (size_t i = first_essential; i < term_count; ++i)
+        {
+            candidate_count += estimate_postings(i);
+        }
+        candidate_terms.resize(first_essential);
+        std::iota(candidate_terms.begin(), candidate_terms.end(), size_t{ 0 });
+        std::sort(candidate_terms.begin(), candidate_terms.end(),
+            [&](size_t lhs, size_t rhs)
+            {
+                return estimate_postings(lhs) < estimate_postings(rhs);
+            });
+        std::fill(is_skipped.begin(), is_skipped.end(), false);
+        for (const size_t position : candidate_terms)
+        {
+            const double posting_count = estimate_postings(position);
+            if (posting_count > PRUNING_SEEK_COST * std::min<double>(candidate_count, window_last - window_first))
+            {
+                is_skipped[terms[position].term_index] = true;
+            }
+            else
+            {
+                candidate_count += posting_count;
             }
         }
-    );
-    std::for_each(policy,
-        query.minus_words.begin(), query.minus_words.end(),
-        [this, &document_to_relevance](std::string_view word)
+        skipped_terms.clear();
+        skipped_score_prefix.clear();
+        for (size_t i = 0; i < first_essential; ++i)
         {
-            if (!word_to_document_freqs_.count(word) == 0)
+            if (is_skipped[terms[i].term_index])
             {
-                for (const auto [document_id, _] : word_to_document_freqs_.at(word))
+                skipped_terms.push_back(i);
+                skipped_score_prefix.push_back((skipped_score_prefix.empty() ? 0.0 : skipped_score_prefix.back()) + terms[i].max_score);
+            }
+        }
+
+        for (size_t i = 0; i < term_count; ++i)
+        {
+            if (!is_skipped[i])
+            {
+                AccumulateTerm(*query.plus_terms[i].part_postings[part], query.plus_terms[i].inverse_document_freq,
+                    document_filter, scorer, is_filtered, window_first, window_last, document_to_relevance);
+            }
+        }
+
+        const double skipped_score = skipped_score_prefix.empty() ? 0.0 : skipped_score_prefix.back();
+        document_to_relevance.ForEachTouchedInRange(window_first, window_last, [&](uint32_t ordinal)
+            {
+                if (!OrdinalFilter::IS_CHEAP && removed_ordinals_[ordinal])
                 {
-                    document_to_relevance.Erase(document_id);
+                    return;
                 }
-            }
+                const double essential_score = document_to_relevance.GetRelevance(ordinal);
+                double score = essential_score;
+                if (score + skipped_score < min_score)
+                {
+                    return;
+                }
+                // необязательные списки - от самой большой границы к меньшим, пока документ еще может пройти
+                bool has_skipped = false;
+                for (size_t i = skipped_terms.size(); i-- > 0;)
+                {
+                    if (score + skipped_score_prefix[i] < min_score)
+                    {
+                        return;
+                    }
+                    PrunedTerm& term = terms[skipped_terms[i]];
+                    if (!term.cursor)
+                    {
+                        term.cursor.emplace(*query.plus_terms[term.term_index].part_postings[part], ordinal);
+                    }
+                    term.cursor->Seek(ordinal);
+                    double& term_score = term_scores[term.term_index];
+                    term_score = 0;
+                    if (!term.cursor->IsEnd() && term.cursor->GetOrdinal() == ordinal)
+                    {
+                        term_score = scorer.Score(ordinal, term.cursor->GetTermFreq(), query.plus_terms[term.term_index].inverse_document_freq);
+                        score += term_score;
+                        has_skipped = true;
+                    }
+                }
+                if (score < min_score)
+                {
+                    return;
+                }
+
+                if (!OrdinalFilter::IS_CHEAP && !document_filter(ordinal))
+                {
+                    return;
+                }
+                // сумма только обязательных слов уже сложена в порядке запроса; иначе складываем заново,
+                // чтобы релевантность совпала с полным перебором до бита
+                double relevance = essential_score;
+                if (has_skipped)
+                {
+                    relevance = 0;
+                    for (size_t i = 0; i < term_count; ++i)
+                    {
+                        if (is_skipped[i])
+                        {
+                            relevance += term_scores[i];
+                            continue;
+                        }
+                        std::optional<PostingList::Cursor>& cursor = exact_cursors[i];
+                        if (!cursor)
+                        {
+                            cursor.emplace(*query.plus_terms[i].part_postings[part], ordinal);
+                        }
+                        cursor->Seek(ordinal);
+                        if (!cursor->IsEnd() && cursor->GetOrdinal() == ordinal)
+                        {
+                            relevance += scorer.Score(ordinal, cursor->GetTermFreq(), query.plus_terms[i].inverse_document_freq);
+                        }
+                    }
+                }
+                matched_documents.Push({ ordinal_to_document_id_[ordinal], relevance, document_ratings_[ordinal] });
+                if (matched_documents.IsFull())
+                {
+                    min_score = matched_documents.GetWorst().relevance - 2 * EPSILON;
+                }
+            });
+        window_first = window_last;
+    }
+}
+
+template <typename OrdinalFilter, typename Scorer>
+void SearchServer::ScoreDocuments(const SearchServer::Query& query, OrdinalFilter& document_filter, const Scorer& scorer,
+    size_t part, uint32_t first_ordinal, uint32_t last_ordinal, TopDocuments& matched_documents) const
+{
+    size_t posting_count = 0;
+    if (is_pruning_enabled_ && query.plus_terms.size() > 1)
+    {
+        for (const QueryTerm& term : query.plus_terms)
+        {
+            posting_count += term.part_postings[part]->size();
         }
-    );
-    for (const auto& [document_id, relevance] : document_to_relevance.BuildOrdinaryMap())
+    }
+    if (posting_count >= PRUNING_MIN_POSTINGS)
     {
-        matched_documents.emplace_back(Document(document_id, relevance, documents_.at(document_id).rating)
-        );
+        FindDocumentsPruned(query, document_filter, scorer, part, first_ordinal, last_ordinal, matched_documents);
+    }
+    else
+    {
+        FindDocumentsInRange(query, document_filter, scorer, part, first_ordinal, last_ordinal, matched_documents);
     }
-    return matched_documents;
 }
 
-template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(const SearchServer::Query& query,
-    DocumentPredicate document_predicate) const
+template <typename OrdinalFilter, typename Scorer>
+TopDocuments SearchServer::FindAllDocuments(std::execution::sequenced_policy policy,
+    const SearchServer::Query& query,
+    OrdinalFilter document_filter, size_t top_count, const Scorer& scorer) const
 {
-    return SearchServer::FindAllDocuments(std::execution::seq, query, document_predicate);
+    TopDocuments matched_documents(top_count);
+    for (size_t part = 0; part < GetPartCount(); ++part)
+    {
+        const auto [first_ordinal, last_ordinal] = GetPartOrdinals(part);
+        ScoreDocuments(query, document_filter, scorer, part, first_ordinal, last_ordinal, matched_documents);
+    }
+    return matched_documents;
 }
 
-// шаблность добавил что-бы не запутатся,т.к. сортировать надо только в par верси
-// + хотелось выражение "if constexpr (!std::is_same_v<ExecutionPolicy, std::execution::parallel_policy>)" 
-// еще поиспользовать 
-template <typename ExecutionPolicy>
-SearchServer::Query SearchServer::ParseQuery(ExecutionPolicy&& policy, std::string_view text) const
-{
-    const std::vector<std::string_view> query_words = SplitIntoWords(text);
-    SearchServer::Query result;
-    result.plus_words.reserve(query_words.size());
 
-    for (std::string_view word : query_words)
+template <typename OrdinalFilter, typename Scorer>
+TopDocuments SearchServer::FindAllDocuments(std::execution::parallel_policy policy,
+    const SearchServer::Query& query,
+    OrdinalFilter document_filter, size_t top_count, const Scorer& scorer) const
+{
+    size_t posting_count = 0;
+    for (const auto& terms : { &query.plus_terms, &query.minus_terms })
     {
-        const auto query_word = ParseQueryWord(word);
-        if (!query_word.is_stop)
+        for (const QueryTerm& term : *terms)
         {
-            if (query_word.is_minus)
-            {
-                result.minus_words.push_back(query_word.data);
-            }
-            else
-            {
-                result.plus_words.push_back(query_word.data);
-            }
+            posting_count += term_stats_[term.term_id].document_count;
         }
     }
-
-    if constexpr (!std::is_same_v<ExecutionPolicy, std::execution::parallel_policy>)
+    // на коротких запросах запуск потоков дороже самого поиска
+    ThreadPool& thread_pool = GetThreadPool();
+    const size_t thread_count = std::min(thread_pool.GetConcurrency(), posting_count / MIN_POSTINGS_PER_THREAD);
+    if (thread_count <= 1)
     {
-        sort(result.minus_words.begin(), result.minus_words.end());
-        auto minus_word = unique(result.minus_words.begin(), result.minus_words.end());
-        result.minus_words.erase(minus_word, result.minus_words.end());
+        return FindAllDocuments(std::execution::seq, query, document_filter, top_count, scorer);
+    }
 
-        sort(result.plus_words.begin(), result.plus_words.end());
-        auto plus_word = unique(result.plus_words.begin(), result.plus_words.end());
-        result.plus_words.erase(plus_word, result.plus_words.end());
+    // задачи не пересекаются по документам: у каждой свой накопитель и свой top,
+    // складывать релевантность между потоками не нужно.
+    // Индекс из нескольких частей (шардов, сегментов) обходится по частям, иначе документы делятся на диапазоны номеров
+    struct ScoringTask
+    {
+        size_t part;
+        uint32_t first_ordinal;
+        uint32_t last_ordinal;
+    };
+    std::vector<ScoringTask> tasks;
+    if (GetPartCount() > 1)
+    {
+        for (size_t part = 0; part < GetPartCount(); ++part)
+        {
+            const auto [first_ordinal, last_ordinal] = GetPartOrdinals(part);
+            tasks.push_back({ part, first_ordinal, last_ordinal });
+        }
     }
+    else
+    {
+        const uint64_t ordinal_count = ordinal_to_document_id_.size();
+        for (size_t part = 0; part < thread_count; ++part)
+        {
+            tasks.push_back({ 0,
+                static_cast<uint32_t>(ordinal_count * part / thread_count),
+                static_cast<uint32_t>(ordinal_count * (part + 1) / thread_count) });
+        }
+    }
+    std::vector<TopDocuments> shard_documents(tasks.size(), TopDocuments(top_count));
+    thread_pool.ParallelFor(tasks.size(),
+        [&](size_t i)
+        {
+            ScoreDocuments(query, document_filter, scorer, tasks[i].part, tasks[i].first_ordinal, tasks[i].last_ordinal,
+                shard_documents[i]);
+        }
+    );
+    TopDocuments matched_documents(top_count);
+    for (const TopDocuments& documents : shard_documents)
+    {
+        matched_documents.Merge(documents);
+    }
+    return matched_documents;
+}
 
-    return result;
+template <typename OrdinalFilter, typename Scorer>
+TopDocuments SearchServer::FindAllDocuments(const SearchServer::Query& query,
+    OrdinalFilter document_filter, size_t top_count, const Scorer& scorer) const
+{
+    return SearchServer::FindAllDocuments(std::execution::seq, query, document_filter, top_count, scorer);
 }
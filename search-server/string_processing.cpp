@@ -1,16 +1,159 @@
 #include "string_processing.h"
 
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SEARCH_SERVER_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(SEARCH_SERVER_SSE2) && defined(__GNUC__)
+#define SEARCH_SERVER_AVX2
+#include <immintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace {
+const size_t BLOCK_SIZE = 64;
+
+// маски блока из BLOCK_SIZE байт: бит i относится к байту i
+struct BlockMasks {
+    uint64_t spaces = 0;
+    uint64_t invalid = 0;
+};
+
+using ScanBlockFunction = BlockMasks (*)(const char* block);
+
+size_t CountTrailingZeros(uint64_t mask) {
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanForward64(&index, mask);
+    return index;
+#elif defined(__GNUC__)
+    return __builtin_ctzll(mask);
+#else
+    size_t index = 0;
+    while ((mask & 1) == 0) {
+        mask >>= 1;
+        ++index;
+    }
+    return index;
+#endif
+}
+
+#ifndef SEARCH_SERVER_SSE2
+BlockMasks ScanBlockScalar(const char* block) {
+    BlockMasks masks;
+    for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+        const unsigned char c = static_cast<unsigned char>(block[i]);
+        masks.spaces |= static_cast<uint64_t>(c == ' ') << i;
+        masks.invalid |= static_cast<uint64_t>(c < ' ') << i;
+    }
+    return masks;
+}
+#endif
+
+#ifdef SEARCH_SERVER_SSE2
+BlockMasks ScanBlockSse2(const char* block) {
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i max_invalid = _mm_set1_epi8(' ' - 1);
+    BlockMasks masks;
+    for (size_t i = 0; i < BLOCK_SIZE; i += 16) {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + i));
+        // беззнаковое сравнение bytes <= 31: минимум с 31 совпадает с самим байтом
+        const __m128i invalid = _mm_cmpeq_epi8(_mm_min_epu8(bytes, max_invalid), bytes);
+        masks.spaces |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, space)))) << i;
+        masks.invalid |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(invalid))) << i;
+    }
+    return masks;
+}
+#endif
+
+#ifdef SEARCH_SERVER_AVX2
+__attribute__((target("avx2")))
+BlockMasks ScanBlockAvx2(const char* block) {
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i max_invalid = _mm256_set1_epi8(' ' - 1);
+    BlockMasks masks;
+    for (size_t i = 0; i < BLOCK_SIZE; i += 32) {
+        const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + i));
+        const __m256i invalid = _mm256_cmpeq_epi8(_mm256_min_epu8(bytes, max_invalid), bytes);
+        masks.spaces |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, space)))) << i;
+        masks.invalid |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(invalid))) << i;
+    }
+    return masks;
+}
+#endif
+
+ScanBlockFunction SelectScanBlock() {
+#ifdef SEARCH_SERVER_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return ScanBlockAvx2;
+    }
+#endif
+#ifdef SEARCH_SERVER_SSE2
+    return ScanBlockSse2;
+#else
+    return ScanBlockScalar;
+#endif
+}
+}
 
 std::vector<std::string_view> SplitIntoWords(std::string_view str) {
     std::vector<std::string_view> result;
-    str.remove_prefix(std::min(str.size(), str.find_first_not_of(" ")));
-    const size_t pos_end = str.npos;
-    while (!str.empty()) {
-        size_t space_pos = str.find(' ');
-        result.push_back(space_pos == pos_end ? str.substr(0, pos_end) : str.substr(0, space_pos));
-        str.remove_prefix(std::min(str.size(), space_pos));
-        str.remove_prefix(std::min(str.size(), str.find_first_not_of(" ")));
-    }
+    SplitIntoWords(str, result);
     return result;
 }
 
+size_t SplitIntoWords(std::string_view str, std::vector<std::string_view>& words) {
+    static const ScanBlockFunction scan_block = SelectScanBlock();
+
+    words.clear();
+    size_t first_invalid_pos = str.npos;
+    size_t word_begin = 0;
+    // был ли пробелом байт перед блоком; перед началом текста считаем, что был
+    uint64_t previous_space = 1;
+    char tail[BLOCK_SIZE];
+    for (size_t offset = 0; offset < str.size(); offset += BLOCK_SIZE) {
+        const char* block = str.data() + offset;
+        if (str.size() - offset < BLOCK_SIZE) {
+            // хвост дополняем пробелами, чтобы не читать за концом строки
+            std::memset(tail, ' ', BLOCK_SIZE);
+            std::memcpy(tail, block, str.size() - offset);
+            block = tail;
+        }
+        const BlockMasks masks = scan_block(block);
+        if (masks.invalid != 0 && first_invalid_pos == str.npos) {
+            first_invalid_pos = offset + CountTrailingZeros(masks.invalid);
+        }
+        // границы слов - байты, которые отличаются от предыдущего тем, пробел ли это
+        uint64_t boundaries = masks.spaces ^ ((masks.spaces << 1) | previous_space);
+        previous_space = masks.spaces >> (BLOCK_SIZE - 1);
+        while (boundaries != 0) {
+            const size_t bit = CountTrailingZeros(boundaries);
+            boundaries &= boundaries - 1;
+            if ((masks.spaces >> bit) & 1) {
+                words.push_back(str.substr(word_begin, offset + bit - word_begin));
+            } else {
+                word_begin = offset + bit;
+            }
+        }
+    }
+    if (previous_space == 0) {
+        words.push_back(str.substr(word_begin));
+    }
+
+    if (first_invalid_pos == str.npos) {
+        return NO_INVALID_WORD;
+    }
+    // управляющий символ не пробел, значит он внутри какого-то слова
+    const char* invalid_char = str.data() + first_invalid_pos;
+    const auto it = std::upper_bound(words.begin(), words.end(), invalid_char,
+        [](const char* pos, std::string_view word) {
+            return pos < word.data();
+        });
+    return static_cast<size_t>(it - words.begin()) - 1;
+}
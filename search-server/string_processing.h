@@ -1,13 +1,21 @@
 #pragma once
 #include <algorithm>
+#include <cstddef>
 #include <vector>
 #include <string>
 #include <string_view>
 #include <set>
 
+// SplitIntoWords возвращает его, если в тексте нет недопустимых символов
+const size_t NO_INVALID_WORD = static_cast<size_t>(-1);
 
 std::vector<std::string_view> SplitIntoWords(std::string_view str);
 
+// Разбивает str по пробелам в words: прежнее содержимое стирается, выделенная память переиспользуется.
+// За тот же проход ищет недопустимые символы (коды 0-31) и возвращает номер первого слова с ними
+// или NO_INVALID_WORD. Сканирует блоками AVX2/SSE2, если процессор их поддерживает
+size_t SplitIntoWords(std::string_view str, std::vector<std::string_view>& words);
+
 template <typename StringContainer>
 std::set<std::string, std::less<>> MakeUniqueNonEmptyStrings(const StringContainer& strings) {
     std::set<std::string,std::less<>> non_empty_strings;
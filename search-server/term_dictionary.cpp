@@ -0,0 +1,60 @@
+#include "term_dictionary.h"
+
+#include <algorithm>
+#include <cstring>
+
+TermDictionary::TermDictionary(const TermDictionary& other) {
+    terms_.reserve(other.terms_.size());
+    term_to_id_.reserve(other.term_to_id_.size());
+    // слова заносятся в порядке id, поэтому id совпадают
+    for (const std::string_view term : other.terms_) {
+        Intern(term);
+    }
+}
+
+TermId TermDictionary::Intern(std::string_view term) {
+    const auto it = term_to_id_.find(term);
+    if (it != term_to_id_.end()) {
+        return it->second;
+    }
+    const TermId term_id = static_cast<TermId>(terms_.size());
+    const std::string_view stored = Store(term);
+    terms_.push_back(stored);
+    term_to_id_.emplace(stored, term_id);
+    return term_id;
+}
+
+TermId TermDictionary::Find(std::string_view term) const {
+    const auto it = term_to_id_.find(term);
+    return it == term_to_id_.end() ? INVALID_TERM_ID : it->second;
+}
+
+TermDictionary::Stats TermDictionary::GetStats() const {
+    Stats stats;
+    stats.term_count = terms_.size();
+    for (const size_t block_size : block_sizes_) {
+        stats.arena_bytes += block_size;
+    }
+    stats.used_bytes = used_bytes_;
+    // узел unordered_map: ключ, значение, указатель на следующий и закешированный хеш
+    const size_t node_bytes = sizeof(std::string_view) + sizeof(TermId) + sizeof(void*) + sizeof(size_t);
+    stats.lookup_bytes = term_to_id_.bucket_count() * sizeof(void*)
+        + term_to_id_.size() * node_bytes
+        + terms_.capacity() * sizeof(std::string_view);
+    return stats;
+}
+
+std::string_view TermDictionary::Store(std::string_view term) {
+    if (blocks_.empty() || block_sizes_.back() - last_block_used_ < term.size()) {
+        // длинное слово получает отдельный блок своего размера
+        const size_t block_size = std::max(BLOCK_SIZE, term.size());
+        blocks_.push_back(std::make_unique<char[]>(block_size));
+        block_sizes_.push_back(block_size);
+        last_block_used_ = 0;
+    }
+    char* data = blocks_.back().get() + last_block_used_;
+    std::memcpy(data, term.data(), term.size());
+    last_block_used_ += term.size();
+    used_bytes_ += term.size();
+    return { data, term.size() };
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+using TermId = uint32_t;
+
+const TermId INVALID_TERM_ID = UINT32_MAX;
+
+// Словарь слов индекса: строки лежат подряд в блоках арены, которые только дописываются,
+// поэтому string_view на слово живет столько же, сколько словарь. Каждому слову выдается
+// компактный id, по которому адресуются списки вхождений
+class TermDictionary {
+public:
+    struct Stats {
+        size_t term_count = 0;
+        size_t arena_bytes = 0;   // выделено под строки
+        size_t used_bytes = 0;    // из них занято
+        size_t lookup_bytes = 0;  // оценка памяти хеш-таблицы и таблицы id -> слово
+    };
+
+    TermDictionary() = default;
+    // копия со своей ареной и теми же id слов; string_view из other на нее не переводятся
+    TermDictionary(const TermDictionary& other);
+    TermDictionary& operator=(const TermDictionary&) = delete;
+    TermDictionary(TermDictionary&&) = default;
+    TermDictionary& operator=(TermDictionary&&) = default;
+
+    // id слова; если слова еще нет, копирует его в арену
+    TermId Intern(std::string_view term);
+    // id слова или INVALID_TERM_ID
+    TermId Find(std::string_view term) const;
+    std::string_view GetTerm(TermId term_id) const {
+        return terms_[term_id];
+    }
+    size_t size() const {
+        return terms_.size();
+    }
+
+    Stats GetStats() const;
+
+private:
+    static const size_t BLOCK_SIZE = 64 * 1024;
+
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    std::vector<size_t> block_sizes_;
+    size_t last_block_used_ = 0;
+    size_t used_bytes_ = 0;
+    std::vector<std::string_view> terms_;
+    std::unordered_map<std::string_view, TermId> term_to_id_;
+
+    std::string_view Store(std::string_view term);
+};
@@ -0,0 +1,148 @@
+#include "thread_pool.h"
+
+#include <utility>
+
+namespace {
+// пул и номер рабочего потока, который сейчас выполняется в этом потоке
+struct CurrentWorker {
+    const ThreadPool* pool = nullptr;
+    size_t index = 0;
+};
+thread_local CurrentWorker current_worker;
+}
+
+ThreadPool::ThreadPool(size_t worker_count) {
+    workers_.reserve(worker_count);
+    for (size_t i = 0; i < worker_count; ++i) {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+    // потоки запускаем, когда все очереди уже созданы - иначе воровать будет не у кого
+    for (size_t i = 0; i < worker_count; ++i) {
+        workers_[i]->thread = std::thread([this, i] {
+            WorkerLoop(i);
+        });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard guard(sleep_mutex_);
+        stop_ = true;
+    }
+    wake_up_.notify_all();
+    for (auto& worker : workers_) {
+        worker->thread.join();
+    }
+}
+
+size_t ThreadPool::GetWorkerCount() const {
+    return workers_.size();
+}
+
+size_t ThreadPool::GetConcurrency() const {
+    return workers_.size() + 1;
+}
+
+std::vector<ThreadPool::WorkerStats> ThreadPool::GetWorkerStats() const {
+    std::vector<WorkerStats> result;
+    result.reserve(workers_.size());
+    for (const auto& worker : workers_) {
+        WorkerStats stats;
+        {
+            std::lock_guard guard(worker->mutex);
+            stats.queued = worker->tasks.size();
+        }
+        stats.executed = worker->executed.load(std::memory_order_relaxed);
+        stats.stolen = worker->stolen.load(std::memory_order_relaxed);
+        result.push_back(stats);
+    }
+    return result;
+}
+
+std::shared_ptr<ThreadPool> ThreadPool::GetDefault() {
+    static const std::shared_ptr<ThreadPool> pool
+        = std::make_shared<ThreadPool>(std::max(1u, std::thread::hardware_concurrency()) - 1);
+    return pool;
+}
+
+void ThreadPool::Submit(Task task) {
+    // из рабочего потока кладем в свою очередь, снаружи - по кругу
+    const size_t index = current_worker.pool == this
+        ? current_worker.index
+        : next_worker_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+    pending_tasks_.fetch_add(1, std::memory_order_release);
+    {
+        std::lock_guard guard(workers_[index]->mutex);
+        workers_[index]->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard guard(sleep_mutex_);
+    }
+    wake_up_.notify_one();
+}
+
+bool ThreadPool::TryRunTask() {
+    Task task;
+    if (current_worker.pool == this) {
+        const size_t index = current_worker.index;
+        if (!PopTask(index, task) && !StealTask(index, task)) {
+            return false;
+        }
+        workers_[index]->executed.fetch_add(1, std::memory_order_relaxed);
+    } else if (!StealTask(workers_.size(), task)) {
+        return false;
+    }
+    task();
+    return true;
+}
+
+bool ThreadPool::PopTask(size_t worker_index, Task& task) {
+    Worker& worker = *workers_[worker_index];
+    std::lock_guard guard(worker.mutex);
+    if (worker.tasks.empty()) {
+        return false;
+    }
+    // свою очередь разбираем с конца: там самые свежие задачи
+    task = std::move(worker.tasks.back());
+    worker.tasks.pop_back();
+    pending_tasks_.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool ThreadPool::StealTask(size_t thief_index, Task& task) {
+    for (size_t offset = 1; offset <= workers_.size(); ++offset) {
+        const size_t victim_index = (thief_index + offset) % workers_.size();
+        if (victim_index == thief_index) {
+            continue;
+        }
+        Worker& victim = *workers_[victim_index];
+        std::lock_guard guard(victim.mutex);
+        if (victim.tasks.empty()) {
+            continue;
+        }
+        task = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        pending_tasks_.fetch_sub(1, std::memory_order_relaxed);
+        if (thief_index < workers_.size()) {
+            workers_[thief_index]->stolen.fetch_add(1, std::memory_order_relaxed);
+        }
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::WorkerLoop(size_t worker_index) {
+    current_worker = { this, worker_index };
+    while (true) {
+        if (TryRunTask()) {
+            continue;
+        }
+        std::unique_lock lock(sleep_mutex_);
+        wake_up_.wait(lock, [this] {
+            return stop_ || pending_tasks_.load(std::memory_order_acquire) > 0;
+        });
+        if (stop_ && pending_tasks_.load(std::memory_order_acquire) == 0) {
+            return;
+        }
+    }
+}
@@ -0,0 +1,123 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Пул потоков с собственной очередью задач у каждого рабочего потока и воровством задач у соседей.
+// Поток, вызвавший ParallelFor, пока ждет, сам выполняет задачи пула, поэтому вложенный ParallelFor
+// из задачи пула не создает новых потоков и не простаивает
+class ThreadPool {
+public:
+    struct WorkerStats {
+        size_t queued = 0;    // задач в очереди потока сейчас
+        size_t executed = 0;  // выполнено задач всего
+        size_t stolen = 0;    // из них украдено из чужих очередей
+    };
+
+    explicit ThreadPool(size_t worker_count);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t GetWorkerCount() const;
+    // сколько потоков одновременно работают над ParallelFor: рабочие плюс вызывающий
+    size_t GetConcurrency() const;
+    std::vector<WorkerStats> GetWorkerStats() const;
+
+    // вызывает function(i) для всех i из [0, count); диапазон режется на куски не меньше grain_size
+    template <typename Function>
+    void ParallelFor(size_t count, Function function, size_t grain_size = 1);
+
+    // общий пул на hardware_concurrency() - 1 рабочих потоков
+    static std::shared_ptr<ThreadPool> GetDefault();
+
+private:
+    using Task = std::function<void()>;
+
+    struct Worker {
+        mutable std::mutex mutex;
+        std::deque<Task> tasks;
+        std::atomic<size_t> executed{ 0 };
+        std::atomic<size_t> stolen{ 0 };
+        std::thread thread;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_up_;
+    std::atomic<size_t> pending_tasks_{ 0 };
+    std::atomic<size_t> next_worker_{ 0 };
+    bool stop_ = false;
+
+    void Submit(Task task);
+    bool TryRunTask();
+    bool PopTask(size_t worker_index, Task& task);
+    bool StealTask(size_t thief_index, Task& task);
+    void WorkerLoop(size_t worker_index);
+};
+
+template <typename Function>
+void ThreadPool::ParallelFor(size_t count, Function function, size_t grain_size) {
+    const size_t max_chunk_count = (count + std::max<size_t>(grain_size, 1) - 1) / std::max<size_t>(grain_size, 1);
+    // несколько кусков на поток, чтобы было что воровать при неравномерной нагрузке
+    const size_t chunk_count = std::min(max_chunk_count, GetConcurrency() * 4);
+    if (chunk_count <= 1 || workers_.empty()) {
+        for (size_t i = 0; i < count; ++i) {
+            function(i);
+        }
+        return;
+    }
+
+    std::atomic<size_t> remaining(chunk_count);
+    std::mutex done_mutex;
+    std::condition_variable done;
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    auto run_chunk = [&](size_t chunk) {
+        try {
+            const size_t last = count * (chunk + 1) / chunk_count;
+            for (size_t i = count * chunk / chunk_count; i < last; ++i) {
+                function(i);
+            }
+        } catch (...) {
+            std::lock_guard guard(error_mutex);
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+        // под мьютексом, чтобы вызывающий не вышел и не разрушил done, пока мы его будим
+        std::lock_guard guard(done_mutex);
+        if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            done.notify_one();
+        }
+    };
+
+    for (size_t chunk = 1; chunk < chunk_count; ++chunk) {
+        Submit([&run_chunk, chunk] {
+            run_chunk(chunk);
+        });
+    }
+    run_chunk(0);
+    // помогаем, пока есть чужие или свои задачи; когда красть нечего, оставшиеся куски уже выполняются
+    // рабочими потоками - тогда спим до последнего из них
+    while (remaining.load(std::memory_order_acquire) != 0 && TryRunTask()) {
+    }
+    {
+        std::unique_lock lock(done_mutex);
+        done.wait(lock, [&remaining] {
+            return remaining.load(std::memory_order_acquire) == 0;
+        });
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
@@ -0,0 +1,47 @@
+#include "top_documents.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+bool IsMoreRelevant(const Document& lhs, const Document& rhs) {
+    if (std::abs(lhs.relevance - rhs.relevance) < EPSILON) {
+        if (lhs.rating == rhs.rating) {
+            return lhs.id < rhs.id;
+        }
+        return lhs.rating > rhs.rating;
+    }
+    return lhs.relevance > rhs.relevance;
+}
+
+TopDocuments::TopDocuments(size_t top_count)
+    : top_count_(top_count) {
+    heap_.reserve(top_count_);
+}
+
+void TopDocuments::Push(const Document& document) {
+    if (heap_.size() < top_count_) {
+        heap_.push_back(document);
+        std::push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+        return;
+    }
+    if (top_count_ == 0 || !IsMoreRelevant(document, heap_.front())) {
+        return;
+    }
+    std::pop_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    heap_.back() = document;
+    std::push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+}
+
+void TopDocuments::Merge(const TopDocuments& other) {
+    for (const Document& document : other.heap_) {
+        Push(document);
+    }
+}
+
+std::vector<Document> TopDocuments::Extract() {
+    std::sort_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    std::vector<Document> result = std::move(heap_);
+    heap_.clear();
+    return result;
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+#include "document.h"
+
+const double EPSILON = 1e-6;
+
+// true, если lhs должен стоять в выдаче выше rhs:
+// по убыванию релевантности, при равной (с точностью EPSILON) - по убыванию рейтинга, затем по id
+bool IsMoreRelevant(const Document& lhs, const Document& rhs);
+
+// Потоковый отбор top_count лучших документов без сортировки всех найденных.
+// Внутри куча, на вершине которой лежит худший из отобранных документов
+class TopDocuments {
+public:
+    explicit TopDocuments(size_t top_count);
+
+    void Push(const Document& document);
+    // отобрано ли уже top_count документов: тогда новому документу надо обойти GetWorst()
+    bool IsFull() const {
+        return top_count_ > 0 && heap_.size() == top_count_;
+    }
+    const Document& GetWorst() const {
+        return heap_.front();
+    }
+    void Merge(const TopDocuments& other);
+    std::vector<Document> Extract();
+
+private:
+    size_t top_count_;
+    std::vector<Document> heap_;
+};